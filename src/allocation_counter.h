@@ -0,0 +1,69 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef ALLOCATION_COUNTER_H_
+#define ALLOCATION_COUNTER_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace bdm {
+
+// Counts the neurite elements and behaviors created since the last call of
+// Take, for allocation_report_op. Unlike the difference of two agent or
+// behavior counts, it also sees allocations that are freed again in the same
+// step, such as a behavior copied and deleted when it is parked. It also
+// counts the chunks the SlotPools take from the heap, which are the actual
+// heap allocations behind these objects.
+class AllocationCounter {
+ public:
+  static AllocationCounter* Get() {
+    static AllocationCounter kCounter;
+    return &kCounter;
+  }
+
+  // Thread-safe.
+  void AddAgent() { agents_.fetch_add(1, std::memory_order_relaxed); }
+  void AddBehavior() { behaviors_.fetch_add(1, std::memory_order_relaxed); }
+  void AddChunk() { chunks_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Returns the number of agents created since the last call and resets it.
+  uint64_t TakeAgents() { return agents_.exchange(0); }
+  // Returns the number of behaviors created since the last call and resets
+  // it.
+  uint64_t TakeBehaviors() { return behaviors_.exchange(0); }
+  // Returns the number of pool chunks allocated since the last call and
+  // resets it.
+  uint64_t TakeChunks() { return chunks_.exchange(0); }
+
+ private:
+  std::atomic<uint64_t> agents_{0};
+  std::atomic<uint64_t> behaviors_{0};
+  std::atomic<uint64_t> chunks_{0};
+
+  AllocationCounter() {}
+};
+
+// Member of a behavior that counts every construction of the behavior,
+// including the copies BioDynaMo makes with New and NewCopy.
+struct CountedBehavior {
+  CountedBehavior() { AllocationCounter::Get()->AddBehavior(); }
+  CountedBehavior(const CountedBehavior&) {
+    AllocationCounter::Get()->AddBehavior();
+  }
+  CountedBehavior& operator=(const CountedBehavior&) { return *this; }
+};
+
+}  // namespace bdm
+
+#endif  // ALLOCATION_COUNTER_H_
@@ -0,0 +1,80 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef ALLOCATION_REPORT_OP_H_
+#define ALLOCATION_REPORT_OP_H_
+
+#include <sstream>
+#include "allocation_counter.h"
+#include "async_writer.h"
+#include "basic_neurite.h"
+#include "biodynamo.h"
+
+namespace bdm {
+
+// This operation records how many agents and behaviors exist after every step,
+// their difference to the previous step, and how many neurite elements and
+// growth or secretion behaviors were created during the step (see
+// AllocationCounter), together with the number of SlotPool chunks allocated
+// during the step, which are the heap allocations behind them. Behaviors
+// parked on retired elements (see BasicNeurite::ParkBehavior) are counted as
+// existing, since they stay allocated; parking itself creates a copy.
+// neurite_coarsening_op removes agents, so the difference of two steps is only
+// the net change and may be negative.
+struct allocation_report_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(allocation_report_op);
+
+  void operator()() override {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+
+    uint64_t agents = rm->GetNumAgents();
+    uint64_t behaviors = 0;
+    rm->ForEachAgent([&](Agent* agent) {
+      behaviors += agent->GetAllBehaviors().size();
+      if (auto* neurite = dynamic_cast<BasicNeurite*>(agent)) {
+        behaviors += neurite->GetNumDormantBehaviors();
+      }
+    });
+
+    std::ostringstream file;
+    if (!header_written_) {
+      file << "step,agents,agents_delta,new_agents,behaviors,behaviors_delta,"
+              "new_behaviors,pool_chunks\n";
+    }
+    auto* counter = AllocationCounter::Get();
+    file << sim->GetScheduler()->GetSimulatedSteps() << "," << agents << ","
+         << static_cast<int64_t>(agents - last_agents_) << ","
+         << counter->TakeAgents() << ","
+         << behaviors << ","
+         << static_cast<int64_t>(behaviors - last_behaviors_) << ","
+         << counter->TakeBehaviors() << "," << counter->TakeChunks() << "\n";
+    // written in the background, like the other output files
+    auto* writer = AsyncWriter::Get();
+    writer->Write(sim->GetOutputDir() + "/allocations.csv", file.str(),
+                  header_written_);
+    writer->Flush();
+    header_written_ = true;
+    last_agents_ = agents;
+    last_behaviors_ = behaviors;
+  }
+
+ private:
+  bool header_written_ = false;
+  uint64_t last_agents_ = 0;
+  uint64_t last_behaviors_ = 0;
+};
+
+}  // namespace bdm
+
+#endif  // ALLOCATION_REPORT_OP_H_
@@ -0,0 +1,128 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef ASYNC_WRITER_H_
+#define ASYNC_WRITER_H_
+
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Writes files on a background thread, so the simulation continues while the
+// output of a step is written. Files are double buffered: Write collects
+// snapshots of the data to write in the back buffer, and Flush hands it to the
+// writer thread, which writes it while the next back buffer is filled. Flush
+// only blocks if the writer is still busy with the previous buffer. Files are
+// written in the order of the Write calls.
+class AsyncWriter {
+ public:
+  static AsyncWriter* Get() {
+    static AsyncWriter kWriter;
+    return &kWriter;
+  }
+
+  ~AsyncWriter() {
+    Wait();
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      stop_ = true;
+    }
+    condition_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Adds the contents of a file to the back buffer; the file is truncated
+  // unless `append` is set. Must not be called concurrently with Write or
+  // Flush.
+  void Write(const std::string& filename, std::string contents,
+             bool append = false) {
+    back_.push_back({filename, std::move(contents), append});
+  }
+
+  // Hands the back buffer to the writer thread.
+  void Flush() {
+    if (back_.empty()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+      thread_ = std::thread([this]() { Run(); });
+    }
+    condition_.wait(lock, [this]() { return front_.empty(); });
+    front_.swap(back_);
+    lock.unlock();
+    condition_.notify_all();
+  }
+
+  // Flushes the back buffer and waits until all files are written.
+  void Wait() {
+    Flush();
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return front_.empty(); });
+  }
+
+ private:
+  struct File {
+    std::string filename;
+    std::string contents;
+    bool append;
+  };
+
+  std::vector<File> back_;
+  // written by the writer thread; only modified under the mutex
+  std::vector<File> front_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::thread thread_;
+  bool stop_ = false;
+
+  AsyncWriter() {}
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      condition_.wait(lock, [this]() { return stop_ || !front_.empty(); });
+      if (front_.empty()) {
+        return;
+      }
+      // Flush does not touch a non-empty front buffer
+      lock.unlock();
+      for (const auto& file : front_) {
+        std::ofstream out(file.filename,
+                          file.append ? std::ios::app : std::ios::trunc);
+        if (!out.is_open()) {
+          std::cerr << "Failed to open " << file.filename << std::endl;
+          continue;
+        }
+        out << file.contents;
+      }
+      lock.lock();
+      front_.clear();
+      condition_.notify_all();
+    }
+  }
+};
+
+}  // namespace bdm
+
+#endif  // ASYNC_WRITER_H_
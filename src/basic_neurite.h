@@ -0,0 +1,430 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef BASIC_NEURITE_H_
+#define BASIC_NEURITE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "allocation_counter.h"
+#include "behavior_dormancy.h"
+#include "biodynamo.h"
+#include "counter_random.h"
+#include "growth_frontier.h"
+#include "growth_rule.h"
+#include "neuroscience/neuroscience.h"
+#include "sim_param.h"
+#include "slot_pool.h"
+
+namespace bdm {
+
+// Neurite element that keeps its position in the dendritic tree up to date
+// while the tree grows. The path distance to the soma and the branch order are
+// derived from the mother whenever an element is created (elongation, side
+// branch, bifurcation) or re-parented (an existing element is split), so
+// reading them never requires a walk to the root. Mechanics and
+// neurite_coarsening_op later change the lengths of ancestors without touching
+// their descendants, so path distances are refreshed tree by tree with
+// UpdatePathDistances before they are read (see synapse_op).
+// The element also carries the growth rule it follows when dendrites are grown
+// by dendrite_growth_op; new elements inherit the rule of the element they
+// originate from, like behaviors that are always copied to new agents, and
+// join the growth frontier.
+// Behaviors that have nothing to do can park themselves on the element; they
+// are removed from the per-step dispatch until a wake condition occurs.
+// Each element owns a random stream derived from the element it originates
+// from, so growth draws the same numbers regardless of thread assignment,
+// agent order or uid assignment.
+// Elements of finished subtrees are frozen (see neurite_freezing_op) and skip
+// the mechanical interaction until they are touched again.
+// Elements are allocated from a per-thread SlotPool instead of the heap, since
+// growth creates and coarsening removes them in large numbers every step.
+class BasicNeurite : public NeuriteElement {
+  BDM_AGENT_HEADER(BasicNeurite, NeuriteElement, 1);
+
+ public:
+  BasicNeurite() {}
+  // Copies all members; dormant behaviors are deep-copied like the active
+  // behaviors of an agent.
+  BasicNeurite(const BasicNeurite& other)
+      : Base(other),
+        proximal_path_distance_(other.proximal_path_distance_),
+        branch_order_(other.branch_order_),
+        growth_rule_(other.growth_rule_),
+        primary_tip_(other.primary_tip_),
+        random_stream_(other.random_stream_),
+        synapse_anchor_(other.synapse_anchor_),
+        frozen_(other.frozen_),
+        dormant_wake_conditions_(other.dormant_wake_conditions_) {
+    for (auto* behavior : other.dormant_behaviors_) {
+      dormant_behaviors_.push_back(behavior->NewCopy());
+    }
+  }
+  virtual ~BasicNeurite() {
+    for (auto* behavior : dormant_behaviors_) {
+      delete behavior;
+    }
+  }
+
+  static void* operator new(size_t size) {
+    return PoolNew<BasicNeurite>(size);
+  }
+  static void operator delete(void* pointer, size_t size) {
+    PoolDelete<BasicNeurite>(pointer, size);
+  }
+
+  void Initialize(const NewAgentEvent& event) override {
+    Base::Initialize(event);
+    AllocationCounter::Get()->AddAgent();
+
+    auto uid = event.GetUid();
+    auto* existing = dynamic_cast<BasicNeurite*>(event.existing_agent);
+    branch_order_ = existing != nullptr ? existing->branch_order_ : 0;
+    growth_rule_ = existing != nullptr ? existing->growth_rule_
+                                       : static_cast<uint8_t>(kNoGrowth);
+    primary_tip_ = false;
+    frozen_ = false;
+    // Bifurcations and side branches open a new branch; splitting an element
+    // only inserts a new proximal piece on the same branch.
+    if (uid == neuroscience::NeuriteBifurcationEvent::kUid ||
+        uid == neuroscience::SideNeuriteExtensionEvent::kUid ||
+        (uid == neuroscience::NeuriteBranchingEvent::kUid &&
+         event.new_agents.size() == 1)) {
+      branch_order_++;
+    }
+    UpdatePathDistance();
+    InitializeRandomStream(event);
+    if (growth_rule_ != kNoGrowth) {
+      GrowthFrontier::Get()->Add(GetUid());
+    }
+    // dormant behaviors are not in the behavior list of the existing element,
+    // but new elements receive them awake like any other copied behavior
+    if (existing != nullptr) {
+      for (auto* behavior : existing->dormant_behaviors_) {
+        if (behavior->WillBeCopied(uid)) {
+          event.existing_behavior = behavior;
+          auto* copy = behavior->New();
+          copy->Initialize(event);
+          AddBehavior(copy);
+        }
+      }
+    }
+  }
+
+  void Update(const NewAgentEvent& event) override {
+    Base::Update(event);
+    Unfreeze();
+    // a split or side branch gives this element a new proximal mother
+    UpdatePathDistance();
+    WakeBehaviors(kWakeOnNewAgentEvent);
+  }
+
+  Real3 CalculateDisplacement(const InteractionForce* force,
+                              real_t squared_radius, real_t dt) override {
+    if (IsFrozen()) {
+      return {0, 0, 0};
+    }
+    return Base::CalculateDisplacement(force, squared_radius, dt);
+  }
+
+  void ApplyDisplacement(const Real3& displacement) override {
+    if (IsFrozen()) {
+      return;
+    }
+    Base::ApplyDisplacement(displacement);
+    // frozen daughters have to follow the distal end of this element
+    if (displacement[0] != 0 || displacement[1] != 0 || displacement[2] != 0) {
+      UnfreezeDaughters();
+    }
+  }
+
+  // Path length from the soma to the distal end (mass location) of this
+  // element.
+  real_t GetPathDistance() const {
+    return proximal_path_distance_ + GetActualLength();
+  }
+
+  // Path length from the soma to the proximal end of this element.
+  real_t GetProximalPathDistance() const { return proximal_path_distance_; }
+
+  // Recomputes the path distances of this element and of all elements distal
+  // to it from the current lengths.
+  void UpdateSubtreePathDistances() {
+    std::vector<BasicNeurite*> stack = {this};
+    while (!stack.empty()) {
+      auto* element = stack.back();
+      stack.pop_back();
+      element->UpdatePathDistance();
+      for (auto* daughter : {element->GetDaughterLeft().Get(),
+                             element->GetDaughterRight().Get()}) {
+        if (auto* basic = dynamic_cast<BasicNeurite*>(daughter)) {
+          stack.push_back(basic);
+        }
+      }
+    }
+  }
+
+  // Number of branch points between the soma and this element. Elements of a
+  // primary neurite have branch order 0.
+  uint16_t GetBranchOrder() const { return branch_order_; }
+
+  // Sets the growth rule (see GrowthRuleId) of a neurite extended from the
+  // soma. Its tip is the primary tip of the neurite.
+  void SetGrowthRule(uint8_t rule_id) {
+    growth_rule_ = rule_id;
+    primary_tip_ = true;
+    GrowthFrontier::Get()->Add(GetUid());
+  }
+  uint8_t GetGrowthRule() const { return growth_rule_; }
+  bool IsPrimaryTip() const { return primary_tip_; }
+
+  // Removes the behavior from the per-step dispatch of this element until one
+  // of the wake conditions (see WakeCondition) occurs. With
+  // kWakeOnSubstanceChange, `substance` is the substance to wait for.
+  // Meant to be called by the behavior from its Run method. The behavior is
+  // only parked at the end of the step (see FinishParking), so it is not
+  // destroyed while it runs; a wake condition occurring before that cancels
+  // the parking.
+  void ParkBehavior(Behavior* behavior, uint8_t wake_conditions,
+                    int substance = -1) {
+    if (parking_.empty()) {
+      ParkingList::Get()->Add(GetUid());
+    }
+    parking_.push_back({behavior, wake_conditions, substance});
+  }
+
+  // Parks the behaviors passed to ParkBehavior in this step: a copy of each
+  // is kept, and the running instance is removed. Called by
+  // behavior_parking_op once all behaviors of the step have run.
+  void FinishParking() {
+    for (const auto& parking : parking_) {
+      auto* copy = parking.behavior->NewCopy();
+      if (auto* observer = dynamic_cast<DormancyObserver*>(copy)) {
+        observer->OnPark();
+      }
+      dormant_behaviors_.push_back(copy);
+      dormant_wake_conditions_.push_back(parking.wake_conditions);
+      if (parking.wake_conditions & kWakeOnSubstanceChange) {
+        SubstanceWakeList::Get()->Add(parking.substance, GetUid());
+      }
+      RemoveBehavior(parking.behavior);
+    }
+    parking_.clear();
+  }
+
+  // Puts all dormant behaviors waiting for one of the given conditions back
+  // into the per-step dispatch.
+  void WakeBehaviors(uint8_t conditions) {
+    size_t parked = 0;
+    for (const auto& parking : parking_) {
+      if (!(parking.wake_conditions & conditions)) {
+        parking_[parked++] = parking;
+      }
+    }
+    parking_.resize(parked);
+    size_t kept = 0;
+    for (size_t i = 0; i < dormant_behaviors_.size(); i++) {
+      if (dormant_wake_conditions_[i] & conditions) {
+        if (auto* observer =
+                dynamic_cast<DormancyObserver*>(dormant_behaviors_[i])) {
+          observer->OnWake();
+        }
+        AddBehavior(dormant_behaviors_[i]);
+      } else {
+        dormant_behaviors_[kept] = dormant_behaviors_[i];
+        dormant_wake_conditions_[kept++] = dormant_wake_conditions_[i];
+      }
+    }
+    dormant_behaviors_.resize(kept);
+    dormant_wake_conditions_.resize(kept);
+  }
+
+  // Marks the element as the contact point of a synapse. Anchors keep their
+  // geometry when neurites are coarsened (see neurite_coarsening_op).
+  void SetSynapseAnchor() { synapse_anchor_ = true; }
+  bool IsSynapseAnchor() const { return synapse_anchor_; }
+
+  // Returns whether the element will never grow again: no behavior runs on it
+  // (growth behaviors park themselves once the element stops growing) and its
+  // growth rule in the given table no longer applies.
+  bool IsRetired(const std::vector<GrowthRule>& rules) const {
+    if (!GetAllBehaviors().empty()) {
+      return false;
+    }
+    return growth_rule_ == kNoGrowth || growth_rule_ > rules.size() ||
+           !rules[growth_rule_ - 1].Grows(GetDiameter(), IsTerminal());
+  }
+
+  // Frozen elements neither calculate nor apply mechanical displacements.
+  // The flag may be cleared by other threads, hence the atomic accesses.
+  void Freeze() { frozen_ = true; }
+  void Unfreeze() {
+#pragma omp atomic write
+    frozen_ = false;
+  }
+  bool IsFrozen() const {
+    bool frozen;
+#pragma omp atomic read
+    frozen = frozen_;
+    return frozen;
+  }
+
+  // Unfreezes all frozen elements whose mass location is closer than
+  // SimParam::unfreeze_distance. Growing elements call this, so a subtree that
+  // is approached by a growing neurite takes part in mechanics again.
+  // The uniform grid environment only answers neighbor queries up to its box
+  // length, so the distance is capped there. The environment is queried
+  // directly: the execution context would answer from (or fill) a neighbor
+  // cache meant for the mechanics of the agent it currently executes.
+  void UnfreezeNeighbors() {
+    auto* sim = Simulation::GetActive();
+    auto* env = sim->GetEnvironment();
+    real_t distance = sim->GetParam()->Get<SimParam>()->unfreeze_distance;
+    if (auto* grid = dynamic_cast<UniformGridEnvironment*>(env)) {
+      distance = std::min<real_t>(distance, grid->GetBoxLength());
+    }
+    auto unfreeze = L2F([](Agent* agent, real_t) {
+      if (auto* neighbor = dynamic_cast<BasicNeurite*>(agent)) {
+        if (neighbor->IsFrozen()) {
+          neighbor->Unfreeze();
+        }
+      }
+    });
+    env->ForEachNeighbor(unfreeze, *this, distance * distance);
+  }
+
+  size_t GetNumDormantBehaviors() const { return dormant_behaviors_.size(); }
+
+  // Returns the id of the random stream of this element (see CounterRandom).
+  uint64_t GetRandomStream() const {
+    auto* param = Simulation::GetActive()->GetParam();
+    return MixRandomStream(param->random_seed, random_stream_);
+  }
+
+  // Returns the random number generator of this element for the current
+  // simulation step. Generators of different substreams are independent.
+  CounterRandom GetStepRandom(uint32_t substream = 0) const {
+    auto step = Simulation::GetActive()->GetScheduler()->GetSimulatedSteps();
+    return CounterRandom(GetRandomStream(), step, substream);
+  }
+
+ private:
+  float proximal_path_distance_ = 0;
+  uint16_t branch_order_ = 0;
+  uint8_t growth_rule_ = kNoGrowth;
+  bool primary_tip_ = false;
+  uint64_t random_stream_ = 0;
+  bool synapse_anchor_ = false;
+  bool frozen_ = false;
+  std::vector<Behavior*> dormant_behaviors_;
+  std::vector<uint8_t> dormant_wake_conditions_;
+  // behaviors that parked themselves in this step (see ParkBehavior); not
+  // copied with the element, since they point to its behaviors
+  struct Parking {
+    Behavior* behavior;
+    uint8_t wake_conditions;
+    int substance;
+  };
+  std::vector<Parking> parking_;
+
+  // Derives the random stream from the stream of the agent this element
+  // originates from, the kind of event, the position among the siblings
+  // created by the event and the step.
+  void InitializeRandomStream(const NewAgentEvent& event) {
+    uint64_t parent = 0;
+    uint64_t sibling = event.new_agents.size();
+    auto* existing_agent = event.existing_agent;
+    if (auto* existing = dynamic_cast<BasicNeurite*>(existing_agent)) {
+      parent = existing->random_stream_;
+    } else if (auto* soma =
+                   dynamic_cast<neuroscience::NeuronSoma*>(existing_agent)) {
+      // somata are created serially, so their uids are reproducible
+      auto uid = soma->GetUid();
+      parent = MixRandomStream(uid.GetIndex(), uid.GetReused());
+      sibling = soma->GetDaughters().size();
+    }
+    auto step = Simulation::GetActive()->GetScheduler()->GetSimulatedSteps();
+    random_stream_ = MixRandomStream(
+        MixRandomStream(MixRandomStream(parent, event.GetUid()), sibling),
+        step);
+  }
+
+  void UnfreezeDaughters() {
+    for (auto* daughter : {GetDaughterLeft().Get(), GetDaughterRight().Get()}) {
+      if (auto* basic = dynamic_cast<BasicNeurite*>(daughter)) {
+        if (basic->IsFrozen()) {
+          basic->Unfreeze();
+        }
+      }
+    }
+  }
+
+  void UpdatePathDistance() {
+    auto* mother = dynamic_cast<BasicNeurite*>(GetMother().Get());
+    proximal_path_distance_ = mother != nullptr ? mother->GetPathDistance() : 0;
+  }
+};
+
+// This function returns the path length from the soma to the distal end of the
+// given neurite element. Elements of type BasicNeurite answer in constant time,
+// any other neurite element is measured by walking up the tree.
+inline real_t GetPathDistance(NeuriteElement* neurite) {
+  if (auto* basic = dynamic_cast<BasicNeurite*>(neurite)) {
+    return basic->GetPathDistance();
+  }
+  real_t distance = 0;
+  while (neurite != nullptr) {
+    distance += neurite->GetActualLength();
+    neurite = dynamic_cast<NeuriteElement*>(neurite->GetMother().Get());
+  }
+  return distance;
+}
+
+// This function recomputes the path distances of all BasicNeurite elements
+// from the somata down, since the lengths of elements change after the path
+// distances of their descendants were derived. The trees are updated in
+// parallel.
+inline void UpdatePathDistances() {
+  std::vector<BasicNeurite*> roots;
+  Simulation::GetActive()->GetResourceManager()->ForEachAgent(
+      [&](Agent* agent) {
+        if (auto* soma = dynamic_cast<neuroscience::NeuronSoma*>(agent)) {
+          for (const auto& daughter : soma->GetDaughters()) {
+            if (auto* basic = dynamic_cast<BasicNeurite*>(daughter.Get())) {
+              roots.push_back(basic);
+            }
+          }
+        }
+      });
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t i = 0; i < roots.size(); i++) {
+    roots[i]->UpdateSubtreePathDistances();
+  }
+}
+
+// This function wakes the dormant behaviors of all elements that wait for a
+// change of the given substance. Call it after modifying the substance.
+inline void WakeOnSubstanceChange(int substance) {
+  auto* rm = Simulation::GetActive()->GetResourceManager();
+  for (const auto& uid : SubstanceWakeList::Get()->Take(substance)) {
+    if (rm->ContainsAgent(uid)) {
+      auto* neurite = bdm_static_cast<BasicNeurite*>(rm->GetAgent(uid));
+      neurite->WakeBehaviors(kWakeOnSubstanceChange);
+    }
+  }
+}
+
+}  // namespace bdm
+
+#endif  // BASIC_NEURITE_H_
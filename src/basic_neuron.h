@@ -14,7 +14,10 @@
 #ifndef MY_NEURON_H_
 #define MY_NEURON_H_
 
+#include <sstream>
 #include <vector>
+#include "async_writer.h"
+#include "basic_neurite.h"
 #include "biodynamo.h"
 #include "core/agent/cell_division_event.h"
 #include "core/behavior/behavior.h"
@@ -37,7 +40,8 @@ class basic_neuron : public neuroscience::NeuronSoma {
   virtual ~basic_neuron() {}
 
   void AddSynapse(basic_neuron* target, real_t distance, int strength = 1,
-                  int time = 0);
+                  int time = 0, real_t source_path_distance = 0,
+                  real_t target_path_distance = 0);
   const std::vector<Synapses>& GetSynapses() const { return synapses_; }
 
   int GetState() const { return state_; }
@@ -56,18 +60,25 @@ class Synapses {
 
   // Parameterized constructor
   Synapses(basic_neuron* source, basic_neuron* target, double distance = 0.0,
-           int strength = 1, int time = 0)
+           int strength = 1, int time = 0, float source_path_distance = 0,
+           float target_path_distance = 0)
       : source_(source),
         target_(target),
         distance_(distance),
         strength_(strength),
-        time_(time) {}
+        time_(time),
+        source_path_distance_(source_path_distance),
+        target_path_distance_(target_path_distance) {}
 
   basic_neuron* GetSource() const { return source_; }
   basic_neuron* GetTarget() const { return target_; }
   double GetDistance() const { return distance_; }
   int GetStrength() const { return strength_; }
   int GetTime() const { return time_; }
+  // Path length along the source / target neurite from the soma to the
+  // synapse.
+  float GetSourcePathDistance() const { return source_path_distance_; }
+  float GetTargetPathDistance() const { return target_path_distance_; }
 
   void IncreaseStrength(int amount = 1) { strength_ += amount; }
 
@@ -77,15 +88,21 @@ class Synapses {
   double distance_;
   int strength_;
   int time_;
+  float source_path_distance_ = 0;
+  float target_path_distance_ = 0;
 };
 
 // This function adds a new Synapse to the current neuron.
 // It takes a target neuron, the distance to the target, the strength of the
-// synapse, and the time of synapse formation as arguments. It creates a new
-// Synapse with these parameters and adds it to the neuron's list of synapses.
+// synapse, the time of synapse formation and the path distances from both
+// somata to the synapse as arguments. It creates a new Synapse with these
+// parameters and adds it to the neuron's list of synapses.
 inline void basic_neuron::AddSynapse(basic_neuron* target, real_t distance,
-                                     int strength, int time) {
-  Synapses synapse(this, target, distance, strength, time);
+                                     int strength, int time,
+                                     real_t source_path_distance,
+                                     real_t target_path_distance) {
+  Synapses synapse(this, target, distance, strength, time,
+                   source_path_distance, target_path_distance);
   synapses_.push_back(synapse);
 }
 
@@ -128,7 +145,8 @@ inline bool hasSynapse(const basic_neuron* neuronA,
 // It first finds the parent neurons of the neurite elements.
 // If both parent neurons are valid and there is no existing synapse between
 // them, it adds a new synapse from the first neuron to the second. The synapse
-// is characterized by its distance, strength, and the time when it was formed.
+// is characterized by its distance, strength, the time when it was formed and
+// the path distance from each soma to the contact.
 inline void CreateSynapseBetweenNeurites(NeuriteElement* neurite1,
                                          NeuriteElement* neurite2,
                                          real_t distance = 0.0,
@@ -142,7 +160,13 @@ inline void CreateSynapseBetweenNeurites(NeuriteElement* neurite1,
     // avoid duplicate synapses
     if (!hasSynapse(neuronA, neuronB)) {
       // Create a Synapses object
-      neuronA->AddSynapse(neuronB, distance, strength, time);
+      neuronA->AddSynapse(neuronB, distance, strength, time,
+                          GetPathDistance(neurite1), GetPathDistance(neurite2));
+      for (auto* neurite : {neurite1, neurite2}) {
+        if (auto* basic = dynamic_cast<BasicNeurite*>(neurite)) {
+          basic->SetSynapseAnchor();
+        }
+      }
     }
   } else {
     std::cerr << "Failed to find parent neurons for neurites!" << std::endl;
@@ -168,7 +192,8 @@ struct PairHash {
 // neurons. Each row in the CSV file represents a connection from one neuron to
 // another. The columns of the CSV file are the source neuron's UID, the target
 // neuron's UID, the cell type of the source neuron, and the count of synapses
-// between the source and target neurons.
+// between the source and target neurons. The list is copied into a buffer and
+// written in the background (see AsyncWriter).
 inline void export_connection_list() {
   // Get the active simulation and its resource manager
   auto* sim = Simulation::GetActive();
@@ -195,11 +220,7 @@ inline void export_connection_list() {
   });
 
   // Export to CSV
-  std::ofstream file("connection_list.csv");
-  if (!file.is_open()) {
-    std::cout << "Failed to open file" << std::endl;
-    return;
-  }
+  std::ostringstream file;
 
   // Write CSV header
   file << "Source_UID,Target_UID,Cell_Type,Synapse_Count" << std::endl;
@@ -219,7 +240,9 @@ inline void export_connection_list() {
     }
   }
 
-  file.close();
+  auto* writer = AsyncWriter::Get();
+  writer->Write("connection_list.csv", file.str());
+  writer->Flush();
 }
 
 }  // namespace bdm
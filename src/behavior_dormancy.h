@@ -0,0 +1,121 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef BEHAVIOR_DORMANCY_H_
+#define BEHAVIOR_DORMANCY_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Events that wake a dormant behavior (see BasicNeurite::ParkBehavior).
+enum WakeCondition : uint8_t {
+  // the element is split, branches or bifurcates
+  kWakeOnNewAgentEvent = 1 << 0,
+  // the substance the behavior follows is changed (WakeOnSubstanceChange)
+  kWakeOnSubstanceChange = 1 << 1
+};
+
+// Interface of behaviors that need to know whether they are parked. They
+// derive from it in addition to Behavior; BasicNeurite notifies the dormant
+// copy of a parked behavior and a behavior that is woken.
+class DormancyObserver {
+ public:
+  virtual ~DormancyObserver() {}
+  virtual void OnPark() = 0;
+  virtual void OnWake() = 0;
+};
+
+// Elements that hold behaviors waiting for a change of a substance.
+class SubstanceWakeList {
+ public:
+  static SubstanceWakeList* Get() {
+    static SubstanceWakeList kList;
+    return &kList;
+  }
+
+  // Registers an element to be woken when the substance changes. Thread-safe.
+  void Add(int substance, const AgentUid& uid) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    sleepers_[substance].push_back(uid);
+  }
+
+  // Returns and forgets all elements waiting for the substance.
+  std::vector<AgentUid> Take(int substance) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::vector<AgentUid> sleepers;
+    sleepers.swap(sleepers_[substance]);
+    return sleepers;
+  }
+
+  // Forgets the elements for which removed(uid) returns true, e.g. elements
+  // removed from the simulation, which would otherwise be kept until their
+  // substance changes, possibly forever. Thread-safe.
+  template <typename TPredicate>
+  void Purge(TPredicate removed) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto& entry : sleepers_) {
+      auto& uids = entry.second;
+      uids.erase(std::remove_if(uids.begin(), uids.end(), removed),
+                 uids.end());
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<int, std::vector<AgentUid>> sleepers_;
+
+  SubstanceWakeList() {}
+};
+
+// Elements with behaviors that parked themselves in this step. Parking only
+// takes effect at the end of the step (see behavior_parking_op), so a behavior
+// is never destroyed while it runs. Elements are stored by uid because load
+// balancing may move agents in memory.
+class ParkingList {
+ public:
+  static ParkingList* Get() {
+    static ParkingList kList;
+    return &kList;
+  }
+
+  // Registers an element with pending parkings. Thread-safe.
+  void Add(const AgentUid& uid) {
+    pending_[ThreadInfo::GetInstance()->GetMyThreadId()].push_back(uid);
+  }
+
+  // Returns and forgets all registered elements. Must not be called
+  // concurrently with Add.
+  std::vector<AgentUid> Take() {
+    std::vector<AgentUid> elements;
+    for (auto& pending : pending_) {
+      elements.insert(elements.end(), pending.begin(), pending.end());
+      pending.clear();
+    }
+    return elements;
+  }
+
+ private:
+  std::vector<std::vector<AgentUid>> pending_;
+
+  ParkingList() : pending_(ThreadInfo::GetInstance()->GetMaxThreads()) {}
+};
+
+}  // namespace bdm
+
+#endif  // BEHAVIOR_DORMANCY_H_
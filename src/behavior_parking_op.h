@@ -0,0 +1,45 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef BEHAVIOR_PARKING_OP_H_
+#define BEHAVIOR_PARKING_OP_H_
+
+#include "basic_neurite.h"
+#include "behavior_dormancy.h"
+#include "biodynamo.h"
+
+namespace bdm {
+
+// This operation parks the behaviors that called BasicNeurite::ParkBehavior
+// during the step. It runs after all other operations, so no behavior is
+// removed while it or the behaviors of its element run. Elements are
+// processed in parallel; each only modifies itself.
+struct behavior_parking_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(behavior_parking_op);
+
+  void operator()() override {
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    auto elements = ParkingList::Get()->Take();
+#pragma omp parallel for
+    for (size_t i = 0; i < elements.size(); i++) {
+      if (rm->ContainsAgent(elements[i])) {
+        bdm_static_cast<BasicNeurite*>(rm->GetAgent(elements[i]))
+            ->FinishParking();
+      }
+    }
+  }
+};
+
+}  // namespace bdm
+
+#endif  // BEHAVIOR_PARKING_OP_H_
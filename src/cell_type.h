@@ -0,0 +1,49 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef CELL_TYPE_H_
+#define CELL_TYPE_H_
+
+#include <vector>
+#include "biodynamo.h"
+#include "growth_rule.h"
+
+namespace bdm {
+
+// A neurite extended from the soma when a neuron is created: it starts in
+// the given direction and grows under the growth rule with the given id (see
+// GrowthRuleId).
+struct InitialNeurite {
+  std::vector<real_t> direction;
+  int rule;
+};
+
+// The initial neurites of the neurons of one cell type. Cell types only
+// differ in their neurites and the rules these follow, so a new cell type is
+// a new entry in SimParam::cell_types, possibly with new growth rules.
+struct CellType {
+  std::vector<InitialNeurite> neurites;
+};
+
+// Pyramidal neurons have one apical dendrite growing up and three basal
+// dendrites growing down.
+inline CellType PyramidalCellType() {
+  return {{{{0, 0, 1}, kApicalGrowth},
+           {{0, 0, -1}, kBasalGrowth},
+           {{0, 0.6, -0.8}, kBasalGrowth},
+           {{0.3, -0.6, -0.8}, kBasalGrowth}}};
+}
+
+}  // namespace bdm
+
+#endif  // CELL_TYPE_H_
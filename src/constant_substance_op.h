@@ -0,0 +1,134 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef CONSTANT_SUBSTANCE_OP_H_
+#define CONSTANT_SUBSTANCE_OP_H_
+
+#include <chrono>
+#include <vector>
+#include "biodynamo.h"
+#include "simulation_phase.h"
+#include "substance_sources.h"
+
+namespace bdm {
+
+// This operation suspends the diffusion operation of the PhasePipeline while
+// every diffusion grid is provably constant: it neither diffuses nor decays,
+// and nothing is registered as its source. BioDynaMo diffuses all grids in
+// one operation, so a single changing substance keeps it scheduled. The
+// diffusion operation is resumed as soon as a source of a skipped substance is
+// registered. Suspending it through the pipeline keeps the phases, which also
+// switch diffusion, consistent with the schedule.
+// The time a diffusion step of the constant grids takes is measured once, so
+// GetSkippedTime estimates how much time the skipped steps would have taken.
+struct constant_substance_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(constant_substance_op);
+
+  void operator()() override {
+    auto* sim = Simulation::GetActive();
+    if (!init_) {
+      init_ = true;
+      SkipConstantSubstances(sim);
+      return;
+    }
+    if (!suspended_) {
+      return;
+    }
+    for (auto* grid : constant_) {
+      if (SubstanceSources::Get()->HasSource(grid->GetContinuumId())) {
+        Log::Info("constant_substance_op", "Substance ",
+                  grid->GetContinuumName(),
+                  " gained a source; diffusion is scheduled again");
+        pipeline_->Resume("diffusion");
+        suspended_ = false;
+        return;
+      }
+    }
+    skipped_steps_++;
+  }
+
+  // Sets the pipeline that schedules the diffusion operation; must be called
+  // before the first step.
+  void SetPipeline(PhasePipeline* pipeline) { pipeline_ = pipeline; }
+
+  // Returns the number of diffusion steps that were skipped.
+  uint64_t GetSkippedSteps() const { return skipped_steps_; }
+
+  // Returns the estimated time in seconds the skipped diffusion steps would
+  // have taken.
+  double GetSkippedTime() const { return skipped_steps_ * step_time_; }
+
+ private:
+  bool init_ = false;
+  PhasePipeline* pipeline_ = nullptr;
+  bool suspended_ = false;
+  std::vector<DiffusionGrid*> constant_;
+  // time of one diffusion step of the constant grids in seconds
+  double step_time_ = 0;
+  uint64_t skipped_steps_ = 0;
+
+  static bool IsConstant(const DiffusionGrid* grid) {
+    if (grid->GetDecayConstant() != 0 ||
+        SubstanceSources::Get()->HasSource(grid->GetContinuumId())) {
+      return false;
+    }
+    // the first coefficient weights the box itself
+    const auto& coefficients = grid->GetDiffusionCoefficients();
+    for (size_t i = 1; i < coefficients.size(); i++) {
+      if (coefficients[i] != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void SkipConstantSubstances(Simulation* sim) {
+    auto* rm = sim->GetResourceManager();
+    bool all_constant = true;
+    rm->ForEachDiffusionGrid([&](DiffusionGrid* grid) {
+      if (IsConstant(grid)) {
+        constant_.push_back(grid);
+      } else {
+        all_constant = false;
+      }
+    });
+    if (!all_constant || constant_.empty()) {
+      constant_.clear();
+      return;
+    }
+
+    // a constant grid is left unchanged by a diffusion step
+    auto dt = sim->GetParam()->simulation_time_step;
+    auto start = std::chrono::steady_clock::now();
+    for (auto* grid : constant_) {
+      grid->Diffuse(dt);
+    }
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    step_time_ = duration.count();
+
+    if (pipeline_ == nullptr || !pipeline_->Suspend("diffusion")) {
+      Log::Warning("constant_substance_op",
+                   "No diffusion operation to skip was found");
+      constant_.clear();
+      return;
+    }
+    suspended_ = true;
+    Log::Info("constant_substance_op", "Skipping the diffusion of ",
+              constant_.size(), " constant substances");
+  }
+};
+
+}  // namespace bdm
+
+#endif  // CONSTANT_SUBSTANCE_OP_H_
@@ -0,0 +1,102 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef COUNTER_RANDOM_H_
+#define COUNTER_RANDOM_H_
+
+#include <array>
+#include <cstdint>
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Mixes a value into a 64 bit stream id (splitmix64 finalizer).
+inline uint64_t MixRandomStream(uint64_t stream, uint64_t value) {
+  uint64_t z = (stream ^ (stream >> 31)) + 0x9E3779B97F4A7C15ull * (value + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// Counter-based random number generator (Philox4x32-10). The numbers drawn
+// depend only on the stream (e.g. an agent), the simulation step, the
+// substream and the position of the draw, not on which thread draws them or
+// in which order agents are processed. Growth is therefore reproducible for
+// any number of threads.
+class CounterRandom {
+ public:
+  CounterRandom(uint64_t stream, uint64_t step, uint32_t substream = 0)
+      : key_{static_cast<uint32_t>(stream),
+             static_cast<uint32_t>(stream >> 32)},
+        counter_{0, static_cast<uint32_t>(step),
+                 static_cast<uint32_t>(step >> 32), substream} {}
+
+  // Returns a uniformly distributed number in [min, max).
+  real_t Uniform(real_t min = 0, real_t max = 1) {
+    if (next_ == buffer_.size()) {
+      Refill();
+    }
+    return min + (max - min) * buffer_[next_++];
+  }
+
+  template <int N>
+  MathArray<real_t, N> UniformArray(real_t min = 0, real_t max = 1) {
+    MathArray<real_t, N> array;
+    for (int i = 0; i < N; i++) {
+      array[i] = Uniform(min, max);
+    }
+    return array;
+  }
+
+ private:
+  std::array<uint32_t, 2> key_;
+  std::array<uint32_t, 4> counter_;
+  std::array<real_t, 2> buffer_;
+  size_t next_ = 2;
+
+  // Generates the next block of 128 random bits and converts it into two
+  // numbers in [0, 1) with 53 bit resolution.
+  void Refill() {
+    auto block = Philox(counter_, key_);
+    counter_[0]++;
+    for (size_t i = 0; i < 2; i++) {
+      uint64_t bits = (static_cast<uint64_t>(block[2 * i]) << 32) |
+                      block[2 * i + 1];
+      buffer_[i] = static_cast<real_t>(bits >> 11) * 0x1.0p-53;
+    }
+    next_ = 0;
+  }
+
+  static std::array<uint32_t, 4> Philox(std::array<uint32_t, 4> ctr,
+                                        std::array<uint32_t, 2> key) {
+    constexpr uint32_t kM0 = 0xD2511F53;
+    constexpr uint32_t kM1 = 0xCD9E8D57;
+    constexpr uint32_t kW0 = 0x9E3779B9;
+    constexpr uint32_t kW1 = 0xBB67AE85;
+    for (int round = 0; round < 10; round++) {
+      uint64_t p0 = static_cast<uint64_t>(kM0) * ctr[0];
+      uint64_t p1 = static_cast<uint64_t>(kM1) * ctr[2];
+      ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+             static_cast<uint32_t>(p1),
+             static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+             static_cast<uint32_t>(p0)};
+      key[0] += kW0;
+      key[1] += kW1;
+    }
+    return ctr;
+  }
+};
+
+}  // namespace bdm
+
+#endif  // COUNTER_RANDOM_H_
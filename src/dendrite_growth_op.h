@@ -0,0 +1,405 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef DENDRITE_GROWTH_OP_H_
+#define DENDRITE_GROWTH_OP_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "basic_neurite.h"
+#include "biodynamo.h"
+#include "growth_cone.h"
+#include "growth_frontier.h"
+#include "growth_rule.h"
+#include "sim_param.h"
+#include "substance_field.h"
+
+namespace bdm {
+
+// Everything that grows under one growth rule.
+struct GrowthBatch {
+  const GrowthRule* rule = nullptr;
+  SubstanceField guide;
+  // growing tips
+  GrowthCones cones;
+  // growing elements that are not terminal; they are only thinned (rules that
+  // are not terminal_only)
+  std::vector<BasicNeurite*> interior;
+};
+
+// This operation grows all dendrites of the simulation in one batch. Instead of
+// dispatching a growth behavior per agent, it keeps the state of every growing
+// tip in structure-of-arrays growth cones grouped by growth rule, computes the
+// new step directions, diameters and branching decisions in tight loops, and
+// writes elongation and branching back to the agents once per segment.
+// The rules are read from the table in SimParam, so any number of cell types
+// share this kernel; within a batch all parameters are loop invariants.
+// Only elements in the GrowthFrontier and the cones are visited, so the cost
+// of a step scales with the number of growing elements, not with the size of
+// the trees.
+struct dendrite_growth_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(dendrite_growth_op);
+
+  void operator()() override {
+    auto* sparam = Simulation::GetActive()->GetParam()->Get<SimParam>();
+    Gather();
+    for (size_t id = kNoGrowth + 1; id < batches_.size(); id++) {
+      auto* batch = &batches_[id];
+      Thin(batch);
+      if (batch->cones.size() == 0) {
+        continue;
+      }
+      for (uint32_t substep = 0; substep < sparam->max_growth_substeps;
+           substep++) {
+        if (!Sample(batch, substep)) {
+          break;
+        }
+        Compute(batch);
+      }
+      Scatter(batch, false);
+    }
+  }
+
+  // Materializes the pending elongation of all cones. Call it before the
+  // morphology is read after the simulation.
+  void Flush() {
+    for (size_t id = kNoGrowth + 1; id < batches_.size(); id++) {
+      auto* batch = &batches_[id];
+      auto& cones = batch->cones;
+      cones.ResetStepState();
+      for (size_t i = 0; i < cones.size(); i++) {
+        cones.materialize[i] = !cones.stale[i];
+      }
+      Scatter(batch, true);
+    }
+  }
+
+  // Returns the number of elements that still grow: the growth cones and the
+  // elements of the frontier that exist and whose rule still applies.
+  size_t GetNumGrowing() const {
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    size_t growing = 0;
+    for (const auto& uid : GrowthFrontier::Get()->GetElements()) {
+      if (!rm->ContainsAgent(uid)) {
+        continue;
+      }
+      auto* dendrite = bdm_static_cast<BasicNeurite*>(rm->GetAgent(uid));
+      auto id = dendrite->GetGrowthRule();
+      const auto* rule = id < batches_.size() ? batches_[id].rule : nullptr;
+      growing += rule != nullptr &&
+                 rule->Grows(dendrite->GetDiameter(), dendrite->IsTerminal());
+    }
+    for (const auto& batch : batches_) {
+      growing += batch.cones.size();
+    }
+    return growing;
+  }
+
+ private:
+  // batch i holds the elements following rule id i
+  std::vector<GrowthBatch> batches_;
+
+  // Prepares one batch per rule of the growth rule table.
+  void SetUpBatches() {
+    auto* sim = Simulation::GetActive();
+    const auto& rules = sim->GetParam()->Get<SimParam>()->growth_rules;
+    if (rules.size() > 255) {
+      Log::Fatal("dendrite_growth_op", "At most 255 growth rules supported");
+    }
+    if (sim->GetParam()->Get<SimParam>()->max_growth_substeps > 255) {
+      Log::Fatal("dendrite_growth_op", "At most 255 growth substeps supported");
+    }
+    batches_.resize(rules.size() + 1);
+    for (size_t i = 0; i < rules.size(); i++) {
+      auto& batch = batches_[i + 1];
+      batch.rule = &rules[i];
+      batch.guide = SubstanceField(rules[i].substance);
+      if (!batch.guide.IsDefined()) {
+        Log::Fatal("dendrite_growth_op", "Growth rule ", i + 1,
+                   " refers to undefined substance ", rules[i].substance);
+      }
+    }
+  }
+
+  // Moves the terminal elements of the frontier into growth cones, collects
+  // its growing interior elements, retires those that stopped growing, and
+  // reloads the cones whose elements changed.
+  void Gather() {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+
+    if (batches_.empty()) {
+      SetUpBatches();
+    }
+    for (auto& batch : batches_) {
+      batch.interior.clear();
+    }
+    auto& frontier = GrowthFrontier::Get()->Merge();
+    size_t kept = 0;
+    for (const auto& uid : frontier) {
+      // elements created earlier in this step are not committed to the
+      // resource manager yet; they grow from the next step on
+      if (!rm->ContainsAgent(uid)) {
+        frontier[kept++] = uid;
+        continue;
+      }
+      auto* dendrite = bdm_static_cast<BasicNeurite*>(rm->GetAgent(uid));
+      auto id = dendrite->GetGrowthRule();
+      if (id >= batches_.size()) {
+        Log::Fatal("dendrite_growth_op", "Undefined growth rule ", int(id));
+      }
+      auto& batch = batches_[id];
+      if (batch.rule == nullptr ||
+          !batch.rule->Grows(dendrite->GetDiameter(), dendrite->IsTerminal())) {
+        continue;
+      }
+      if (dendrite->IsTerminal()) {
+        batch.cones.Add(dendrite);
+      } else {
+        batch.interior.push_back(dendrite);
+        frontier[kept++] = uid;
+      }
+    }
+    frontier.resize(kept);
+
+    const auto* sparam = sim->GetParam()->Get<SimParam>();
+    for (size_t id = kNoGrowth + 1; id < batches_.size(); id++) {
+      auto& cones = batches_[id].cones;
+      cones.ResetStepState();
+#pragma omp parallel for
+      for (size_t i = 0; i < cones.size(); i++) {
+        if (!cones.stale[i]) {
+          continue;
+        }
+        auto* tip = bdm_static_cast<BasicNeurite*>(rm->GetAgent(cones.uid[i]));
+        cones.Load(i, tip);
+        cones.substeps[i] = GetSubsteps(tip, sparam);
+      }
+    }
+  }
+
+  // Returns the number of growth steps a tip takes in this simulation step.
+  // With adaptive growth (max_growth_substeps > 1), a tip without other
+  // elements ahead of it within crowding_radius takes the maximum number of
+  // steps; every element found there halves it, down to one step.
+  // The neighbors are queried from the environment, since this runs in a
+  // parallel loop outside of agent execution, where the execution context may
+  // answer from the neighbor cache of another agent. The uniform grid only
+  // answers queries up to its box length, so the radius is capped there.
+  static uint8_t GetSubsteps(const BasicNeurite* tip, const SimParam* sparam) {
+    if (sparam->max_growth_substeps <= 1) {
+      return 1;
+    }
+    const auto& position = tip->GetMassLocation();
+    const auto& axis = tip->GetSpringAxis();
+    uint32_t crowding = 0;
+    auto count = L2F([&](Agent* agent, real_t) {
+      auto delta = agent->GetPosition() - position;
+      if (delta * axis > 0) {
+        crowding++;
+      }
+    });
+    auto* env = Simulation::GetActive()->GetEnvironment();
+    real_t radius = sparam->crowding_radius;
+    if (auto* grid = dynamic_cast<UniformGridEnvironment*>(env)) {
+      radius = std::min<real_t>(radius, grid->GetBoxLength());
+    }
+    env->ForEachNeighbor(count, *tip, radius * radius);
+    uint32_t substeps = crowding < 32 ? sparam->max_growth_substeps >> crowding
+                                      : 0;
+    return static_cast<uint8_t>(std::max(substeps, 1u));
+  }
+
+  // Loads the substance gradient at each tip that takes the given substep and
+  // its random numbers. Returns false if no tip does.
+  static bool Sample(GrowthBatch* batch, uint32_t substep) {
+    auto* sim = Simulation::GetActive();
+    auto step = sim->GetScheduler()->GetSimulatedSteps();
+    auto& cones = batch->cones;
+    bool any = false;
+#pragma omp parallel for reduction(|| : any)
+    for (size_t i = 0; i < cones.size(); i++) {
+      // a tip stops once it wrote its state back to the element
+      cones.advance[i] = substep < cones.substeps[i] && !cones.materialize[i];
+      if (!cones.advance[i]) {
+        continue;
+      }
+      any = true;
+      // substream 1 is reserved for branching
+      CounterRandom random(cones.random_stream[i], step,
+                           substep == 0 ? 0 : substep + 1);
+      auto random_axis = random.UniformArray<3>(-1, 1);
+      cones.rand_x[i] = random_axis[0];
+      cones.rand_y[i] = random_axis[1];
+      cones.rand_z[i] = random_axis[2];
+      cones.branch_draw[i] = random.Uniform();
+    }
+    if (any) {
+      batch->guide.Refine(cones.size(), cones.pos_x.data(),
+                          cones.pos_y.data(), cones.pos_z.data());
+      // one batched query for all tips; the gradients of tips that do not
+      // advance are not used
+      batch->guide.GetGradients(
+          cones.size(), cones.pos_x.data(), cones.pos_y.data(),
+          cones.pos_z.data(), cones.grad_x.data(), cones.grad_y.data(),
+          cones.grad_z.data());
+    }
+    return any;
+  }
+
+  // Thins the growing interior elements. They cannot elongate or branch.
+  static void Thin(GrowthBatch* batch) {
+    const real_t decrement = batch->rule->diameter_decrement;
+    const auto& interior = batch->interior;
+#pragma omp parallel for
+    for (size_t i = 0; i < interior.size(); i++) {
+      interior[i]->SetDiameter(interior[i]->GetDiameter() - decrement);
+    }
+  }
+
+  // Advances the cones that take the current substep: computes new step
+  // directions, elongates and thins the tips and decides which of them
+  // branch, retire or complete a segment. A segment is at least
+  // growth_cone_segment_length long, and at least as long as the steps the tip
+  // takes in one simulation step, so sparse regions get longer elements.
+  // Without adaptive growth (max_growth_substeps == 1) a tip is therefore
+  // written back once per growth_cone_segment_length.
+  static void Compute(GrowthBatch* batch) {
+    auto* sim = Simulation::GetActive();
+    const auto* sparam = sim->GetParam()->Get<SimParam>();
+    const GrowthRule rule = *batch->rule;
+    const real_t w_old = rule.old_direction_weight;
+    const real_t w_rand = rule.randomness_weight;
+    const real_t w_grad = rule.gradient_weight;
+    const real_t decrement = rule.diameter_decrement;
+    const real_t dt = sim->GetParam()->simulation_time_step;
+    const real_t step_length = rule.speed * dt;
+    const real_t segment_length = sparam->growth_cone_segment_length;
+    auto& c = batch->cones;
+    const size_t n = c.size();
+    real_t* axis_x = c.axis_x.data();
+    real_t* axis_y = c.axis_y.data();
+    real_t* axis_z = c.axis_z.data();
+    real_t* pos_x = c.pos_x.data();
+    real_t* pos_y = c.pos_y.data();
+    real_t* pos_z = c.pos_z.data();
+    real_t* pending_x = c.pending_x.data();
+    real_t* pending_y = c.pending_y.data();
+    real_t* pending_z = c.pending_z.data();
+    real_t* diameter = c.diameter.data();
+    const real_t* grad_x = c.grad_x.data();
+    const real_t* grad_y = c.grad_y.data();
+    const real_t* grad_z = c.grad_z.data();
+    const real_t* rand_x = c.rand_x.data();
+    const real_t* rand_y = c.rand_y.data();
+    const real_t* rand_z = c.rand_z.data();
+    const uint8_t* advance = c.advance.data();
+
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+      real_t dir_x =
+          axis_x[i] * w_old + rand_x[i] * w_rand + grad_x[i] * w_grad;
+      real_t dir_y =
+          axis_y[i] * w_old + rand_y[i] * w_rand + grad_y[i] * w_grad;
+      real_t dir_z =
+          axis_z[i] * w_old + rand_z[i] * w_rand + grad_z[i] * w_grad;
+      // like NeuriteElement::ElongateTerminalEnd, a tip does not grow backwards
+      real_t forward =
+          dir_x * axis_x[i] + dir_y * axis_y[i] + dir_z * axis_z[i];
+      real_t norm = std::sqrt(dir_x * dir_x + dir_y * dir_y + dir_z * dir_z);
+      real_t scale =
+          advance[i] && forward > 0 && norm > 0 ? step_length / norm : 0;
+      real_t step_x = dir_x * scale;
+      real_t step_y = dir_y * scale;
+      real_t step_z = dir_z * scale;
+      pos_x[i] += step_x;
+      pos_y[i] += step_y;
+      pos_z[i] += step_z;
+      axis_x[i] += step_x;
+      axis_y[i] += step_y;
+      axis_z[i] += step_z;
+      pending_x[i] += step_x;
+      pending_y[i] += step_y;
+      pending_z[i] += step_z;
+      diameter[i] -= advance[i] ? decrement : 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (!advance[i]) {
+        continue;
+      }
+      c.branch[i] = rule.MayBranch(diameter[i], true, c.primary_tip[i]) &&
+                    c.branch_draw[i] < rule.branch_probability;
+      c.retire[i] = !rule.Grows(diameter[i], true);
+      real_t pending = pending_x[i] * pending_x[i] +
+                       pending_y[i] * pending_y[i] +
+                       pending_z[i] * pending_z[i];
+      real_t segment = std::max(segment_length, c.substeps[i] * step_length);
+      c.materialize[i] =
+          c.branch[i] || c.retire[i] || pending >= segment * segment;
+    }
+  }
+
+  // Writes the pending elongation and thinning of the flagged cones to their
+  // elements in parallel and wakes frozen elements in reach, then branches
+  // serially since branching modifies the mother of the element as well.
+  // A bifurcated tip is no longer terminal; its daughters form new cones.
+  static void Scatter(GrowthBatch* batch, bool flush) {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+    const GrowthRule& rule = *batch->rule;
+    const real_t dt = sim->GetParam()->simulation_time_step;
+    auto& c = batch->cones;
+#pragma omp parallel for
+    for (size_t i = 0; i < c.size(); i++) {
+      if (!c.materialize[i]) {
+        continue;
+      }
+      auto* dendrite = bdm_static_cast<BasicNeurite*>(rm->GetAgent(c.uid[i]));
+      Real3 pending = {c.pending_x[i], c.pending_y[i], c.pending_z[i]};
+      real_t length = pending.Norm();
+      if (length > 0) {
+        dendrite->ElongateTerminalEnd(length / dt, pending);
+      }
+      dendrite->SetDiameter(c.diameter[i]);
+      if (!flush) {
+        dendrite->UnfreezeNeighbors();
+      }
+      c.pending_x[i] = 0;
+      c.pending_y[i] = 0;
+      c.pending_z[i] = 0;
+      c.stale[i] = true;
+    }
+
+    for (size_t i = 0; i < c.size(); i++) {
+      if (!c.branch[i]) {
+        continue;
+      }
+      auto* dendrite = bdm_static_cast<BasicNeurite*>(rm->GetAgent(c.uid[i]));
+      // the numbers of substream 0 were consumed while gathering
+      auto random = dendrite->GetStepRandom(1);
+      BranchTip(rule, dendrite, &random);
+      if (rule.bifurcate) {
+        // the element may still be thinned as an interior element
+        c.retire[i] = true;
+        GrowthFrontier::Get()->Add(c.uid[i]);
+      }
+    }
+    c.RemoveRetired();
+  }
+};
+
+}  // namespace bdm
+
+#endif  // DENDRITE_GROWTH_OP_H_
@@ -0,0 +1,176 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GRADIENT_BENCHMARK_OP_H_
+#define GRADIENT_BENCHMARK_OP_H_
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "biodynamo.h"
+#include "counter_random.h"
+#include "gradient_grid.h"
+#include "sim_param.h"
+#include "substance_field.h"
+
+namespace bdm {
+
+// This operation measures, once, how many gradient queries per second each way
+// of evaluating the guidance substances of the growth rules answers: the
+// finite differences of the diffusion grid, the precomputed gradient grid, the
+// sparse grid, the multi-resolution grid and the analytic field. Only the ways
+// available for the current configuration are measured; set
+// substance_representation to "dense" to compare the ones based on diffusion
+// grids. Single queries run on one thread, the batched query used by growth on
+// all threads, at random positions inside the simulation space. For the
+// gradient grid, batches of several sizes are also answered with and without
+// sorting the queries by box (see GradientGrid::GetGradients).
+struct gradient_benchmark_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(gradient_benchmark_op);
+
+  void operator()() override {
+    if (done_) {
+      return;
+    }
+    done_ = true;
+
+    auto* sim = Simulation::GetActive();
+    auto* param = sim->GetParam();
+    std::vector<Real3> positions(kQueries);
+    CounterRandom random(param->random_seed, 0);
+    for (auto& position : positions) {
+      position = random.UniformArray<3>(param->min_bound, param->max_bound);
+    }
+
+    std::vector<real_t> x(kQueries), y(kQueries), z(kQueries);
+    for (size_t i = 0; i < kQueries; i++) {
+      x[i] = positions[i][0];
+      y[i] = positions[i][1];
+      z[i] = positions[i][2];
+    }
+
+    std::set<int> substances;
+    for (const auto& rule : param->Get<SimParam>()->growth_rules) {
+      substances.insert(rule.substance);
+    }
+    for (int substance : substances) {
+      // batched queries of SubstanceField, the way dendrite_growth_op asks
+      SubstanceField field(substance);
+      if (field.IsDefined()) {
+        ReportBatched(substance, field, x, y, z);
+      }
+      if (auto* analytic = AnalyticSubstances::Get()->Find(substance)) {
+        Report(substance, "analytic", positions,
+               [&](const Real3& position, Real3* gradient) {
+                 analytic->GetGradient(position, gradient);
+               });
+      }
+      if (auto* sparse = SparseSubstances::Get()->Find(substance)) {
+        Report(substance, "sparse grid", positions,
+               [&](const Real3& position, Real3* gradient) {
+                 sparse->GetGradient(position, gradient);
+               });
+      }
+      if (auto* multires = MultiResolutionSubstances::Get()->Find(substance)) {
+        Report(substance, "multi-resolution grid", positions,
+               [&](const Real3& position, Real3* gradient) {
+                 multires->GetGradient(position, gradient);
+               });
+      }
+      auto* grid = sim->GetResourceManager()->GetDiffusionGrid(substance);
+      if (grid != nullptr) {
+        Report(substance, "diffusion grid", positions,
+               [&](const Real3& position, Real3* gradient) {
+                 grid->GetGradient(position, gradient);
+               });
+        auto* gradient_grid = GradientGrids::Get()->Find(substance, grid);
+        Report(substance, "gradient grid", positions,
+               [&](const Real3& position, Real3* gradient) {
+                 gradient_grid->GetGradient(position, gradient);
+               });
+        for (size_t batch : {size_t(1) << 10, size_t(1) << 16, kQueries}) {
+          ReportOrder(substance, *gradient_grid, batch, x, y, z);
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kQueries = 1000000;
+  bool done_ = false;
+
+  static void ReportBatched(int substance, const SubstanceField& field,
+                            const std::vector<real_t>& x,
+                            const std::vector<real_t>& y,
+                            const std::vector<real_t>& z) {
+    std::vector<real_t> gx(x.size()), gy(x.size()), gz(x.size());
+    auto start = std::chrono::steady_clock::now();
+    field.GetGradients(x.size(), x.data(), y.data(), z.data(), gx.data(),
+                       gy.data(), gz.data());
+    std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Gradient queries of substance " << substance
+              << " (batched, all threads): " << x.size() / seconds.count()
+              << " per second" << std::endl;
+  }
+
+  // Answers all queries in batches of the given size, once sorted by box and
+  // once in the given order.
+  static void ReportOrder(int substance, const GradientGrid& gradient_grid,
+                          size_t batch, const std::vector<real_t>& x,
+                          const std::vector<real_t>& y,
+                          const std::vector<real_t>& z) {
+    std::vector<real_t> gx(x.size()), gy(x.size()), gz(x.size());
+    for (bool sort : {true, false}) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t first = 0; first < x.size(); first += batch) {
+        auto n = std::min(batch, x.size() - first);
+        gradient_grid.GetGradients(n, &x[first], &y[first], &z[first],
+                                   &gx[first], &gy[first], &gz[first], true,
+                                   sort);
+      }
+      std::chrono::duration<double> seconds =
+          std::chrono::steady_clock::now() - start;
+      std::cout << "Gradient queries of substance " << substance
+                << " (gradient grid, batches of " << batch << ", "
+                << (sort ? "sorted" : "unsorted")
+                << "): " << x.size() / seconds.count() << " per second"
+                << std::endl;
+    }
+  }
+
+  template <typename TQuery>
+  static void Report(int substance, const std::string& method,
+                     const std::vector<Real3>& positions, TQuery query) {
+    auto start = std::chrono::steady_clock::now();
+    // keeps the queries from being optimized away
+    real_t checksum = 0;
+    for (const auto& position : positions) {
+      Real3 gradient;
+      query(position, &gradient);
+      checksum += gradient[0] + gradient[1] + gradient[2];
+    }
+    std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Gradient queries of substance " << substance << " ("
+              << method << "): " << positions.size() / seconds.count()
+              << " per second (checksum " << checksum << ")" << std::endl;
+  }
+};
+
+}  // namespace bdm
+
+#endif  // GRADIENT_BENCHMARK_OP_H_
@@ -0,0 +1,246 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GRADIENT_GRID_H_
+#define GRADIENT_GRID_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "biodynamo.h"
+#include "packed_storage.h"
+
+namespace bdm {
+
+// Gradient of a diffusion grid whose concentrations do not change, computed
+// once at the center of every box. A query is a trilinear interpolation of the
+// eight surrounding gradients, which are stored contiguously, instead of the
+// finite differences DiffusionGrid::GetGradient computes on every call.
+// The gradients are stored at the given precision and interpolated in real_t;
+// the precision is resolved once per query or batch.
+class GradientGrid {
+ public:
+  explicit GradientGrid(const DiffusionGrid* grid,
+                        StoragePrecision precision = StoragePrecision::kReal)
+      : box_length_(grid->GetBoxLength()), precision_(precision) {
+    auto dimensions = grid->GetDimensions();
+    auto resolution = grid->GetResolution();
+    for (int d = 0; d < 3; d++) {
+      origin_[d] = dimensions[2 * d];
+      boxes_[d] = resolution;
+    }
+    std::array<std::vector<real_t>, 3> gradients;
+    for (auto& component : gradients) {
+      component.resize(boxes_[0] * boxes_[1] * boxes_[2]);
+    }
+#pragma omp parallel for collapse(2)
+    for (size_t z = 0; z < boxes_[2]; z++) {
+      for (size_t y = 0; y < boxes_[1]; y++) {
+        for (size_t x = 0; x < boxes_[0]; x++) {
+          Real3 center = {origin_[0] + (x + 0.5) * box_length_,
+                          origin_[1] + (y + 0.5) * box_length_,
+                          origin_[2] + (z + 0.5) * box_length_};
+          Real3 gradient;
+          grid->GetGradient(center, &gradient, false);
+          auto idx = Index(x, y, z);
+          for (int d = 0; d < 3; d++) {
+            gradients[d][idx] = gradient[d];
+          }
+        }
+      }
+    }
+    storage_.reset(DispatchPrecision(precision, [&](auto sample) -> Storage* {
+      auto* typed = new TypedStorage<decltype(sample)>();
+      typed->gradients = Gradients<decltype(sample)>(gradients);
+      return typed;
+    }));
+  }
+
+  // Same interface as DiffusionGrid::GetGradient.
+  void GetGradient(const Real3& position, Real3* gradient,
+                   bool normalize = true) const {
+    DispatchPrecision(precision_, [&](auto sample) {
+      Interpolate<decltype(sample)>(position[0], position[1], position[2],
+                                    gradient);
+    });
+    if (normalize) {
+      Normalize(gradient);
+    }
+  }
+
+  // Batched GetGradient for the n positions (x[i], y[i], z[i]); writes the
+  // gradients to gx, gy and gz.
+  void GetGradients(size_t n, const real_t* x, const real_t* y,
+                    const real_t* z, real_t* gx, real_t* gy, real_t* gz,
+                    bool normalize = true) const {
+    GetGradients(n, x, y, z, gx, gy, gz, normalize, false);
+  }
+
+  // GetGradients that answers the queries in the order of their boxes if sort
+  // is set, so consecutive queries read neighboring gradients. The serial sort
+  // costs more than the locality saves in the batches measured so far, so
+  // growth does not sort; gradient_benchmark_op compares both orders. Queries
+  // are not sorted if there are more than 2^32 of them or of the boxes.
+  void GetGradients(size_t n, const real_t* x, const real_t* y,
+                    const real_t* z, real_t* gx, real_t* gy, real_t* gz,
+                    bool normalize, bool sort) const {
+    // the box and the query index are sorted as one 64 bit key
+    constexpr uint64_t kMaxIndex = 0xFFFFFFFF;
+    if (n > kMaxIndex || boxes_[0] * boxes_[1] * boxes_[2] > kMaxIndex) {
+      sort = false;
+    }
+    DispatchPrecision(precision_, [&](auto sample) {
+      GetGradientsAs<decltype(sample)>(n, x, y, z, gx, gy, gz, normalize,
+                                       sort);
+    });
+  }
+
+ private:
+  // x, y and z component of the gradient of every box
+  template <typename TSample>
+  using Gradients = PackedArray<TSample, 3>;
+  struct Storage {
+    virtual ~Storage() {}
+  };
+  // gradients of the sample type of the precision of the grid
+  template <typename TSample>
+  struct TypedStorage : public Storage {
+    Gradients<TSample> gradients;
+  };
+
+  std::array<real_t, 3> origin_;
+  real_t box_length_;
+  std::array<size_t, 3> boxes_;
+  StoragePrecision precision_;
+  std::unique_ptr<Storage> storage_;
+
+  template <typename TSample>
+  void GetGradientsAs(size_t n, const real_t* x, const real_t* y,
+                      const real_t* z, real_t* gx, real_t* gy, real_t* gz,
+                      bool normalize, bool sort) const {
+    // box index in the upper, query index in the lower 32 bits
+    std::vector<uint64_t> order;
+    if (sort) {
+      order.resize(n);
+#pragma omp parallel for
+      for (size_t i = 0; i < n; i++) {
+        auto box = Index(Lower(x[i], 0), Lower(y[i], 1), Lower(z[i], 2));
+        order[i] = (static_cast<uint64_t>(box) << 32) | i;
+      }
+      std::sort(order.begin(), order.end());
+    }
+
+#pragma omp parallel for
+    for (size_t k = 0; k < n; k++) {
+      size_t i = sort ? order[k] & 0xFFFFFFFF : k;
+      Real3 gradient;
+      Interpolate<TSample>(x[i], y[i], z[i], &gradient);
+      if (normalize) {
+        Normalize(&gradient);
+      }
+      gx[i] = gradient[0];
+      gy[i] = gradient[1];
+      gz[i] = gradient[2];
+    }
+  }
+
+  size_t Index(size_t x, size_t y, size_t z) const {
+    return (z * boxes_[1] + y) * boxes_[0] + x;
+  }
+
+  // Returns the position along dimension d in units of boxes relative to the
+  // first box center, clamped to the grid.
+  real_t BoxCoordinate(real_t position, int d) const {
+    real_t t = (position - origin_[d]) / box_length_ - 0.5;
+    real_t max = static_cast<real_t>(boxes_[d] - 1);
+    return std::min(std::max(t, real_t(0)), max);
+  }
+
+  size_t Lower(real_t position, int d) const {
+    return static_cast<size_t>(BoxCoordinate(position, d));
+  }
+
+  template <typename TSample>
+  void Interpolate(real_t px, real_t py, real_t pz, Real3* gradient) const {
+    const auto& gradients =
+        static_cast<const TypedStorage<TSample>*>(storage_.get())->gradients;
+    std::array<real_t, 3> position = {px, py, pz};
+    std::array<size_t, 3> lower;
+    std::array<size_t, 3> upper;
+    std::array<real_t, 3> weight;
+    for (int d = 0; d < 3; d++) {
+      real_t t = BoxCoordinate(position[d], d);
+      lower[d] = static_cast<size_t>(t);
+      upper[d] = std::min(lower[d] + 1, boxes_[d] - 1);
+      weight[d] = t - lower[d];
+    }
+
+    real_t sum[3] = {0, 0, 0};
+    for (int corner = 0; corner < 8; corner++) {
+      size_t x = corner & 1 ? upper[0] : lower[0];
+      size_t y = corner & 2 ? upper[1] : lower[1];
+      size_t z = corner & 4 ? upper[2] : lower[2];
+      real_t w = (corner & 1 ? weight[0] : 1 - weight[0]) *
+                 (corner & 2 ? weight[1] : 1 - weight[1]) *
+                 (corner & 4 ? weight[2] : 1 - weight[2]);
+      auto idx = Index(x, y, z);
+      sum[0] += w * gradients.Get(idx, 0);
+      sum[1] += w * gradients.Get(idx, 1);
+      sum[2] += w * gradients.Get(idx, 2);
+    }
+    *gradient = {sum[0], sum[1], sum[2]};
+  }
+
+  static void Normalize(Real3* gradient) {
+    real_t norm = gradient->Norm();
+    if (norm > 1e-10) {
+      *gradient /= norm;
+    }
+  }
+};
+
+// Gradient grids of the static substances, built on first use.
+class GradientGrids {
+ public:
+  static GradientGrids* Get() {
+    static GradientGrids kGrids;
+    return &kGrids;
+  }
+
+  // Returns the gradient grid of the substance, stored at the precision of the
+  // substance (see GetStoragePrecision). Thread-safe.
+  const GradientGrid* Find(int substance, const DiffusionGrid* grid) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto& gradient_grid = grids_[substance];
+    if (gradient_grid == nullptr) {
+      gradient_grid.reset(
+          new GradientGrid(grid, GetStoragePrecision(substance)));
+    }
+    return gradient_grid.get();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<int, std::unique_ptr<GradientGrid>> grids_;
+
+  GradientGrids() {}
+};
+
+}  // namespace bdm
+
+#endif  // GRADIENT_GRID_H_
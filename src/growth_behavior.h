@@ -0,0 +1,193 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GROWTH_BEHAVIOR_H_
+#define GROWTH_BEHAVIOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include "allocation_counter.h"
+#include "basic_neurite.h"
+#include "behavior_dormancy.h"
+#include "biodynamo.h"
+#include "growth_rule.h"
+#include "neuroscience/neuroscience.h"
+#include "slot_pool.h"
+#include "substance_field.h"
+
+namespace bdm {
+
+// Result of one growth step of a tip.
+struct GrowthStep {
+  Real3 direction;
+  real_t diameter;
+  bool branch;
+};
+
+// Computes one growth step of a tip under the rule: the step direction as
+// weighted sum of its current axis, a random direction and the gradient, its
+// thinned diameter, and whether it branches. With a compile-time rule (see
+// ApicalPolicy) all parameters are constants of the inlined code.
+template <typename TRandom>
+inline GrowthStep ComputeGrowthStep(const GrowthRule& rule, const Real3& axis,
+                                    const Real3& gradient, real_t diameter,
+                                    bool terminal, bool primary_tip,
+                                    TRandom* random) {
+  GrowthStep step;
+  auto random_axis = random->template UniformArray<3>(-1, 1);
+  step.direction = axis * rule.old_direction_weight +
+                   random_axis * rule.randomness_weight +
+                   gradient * rule.gradient_weight;
+  step.diameter = diameter - rule.diameter_decrement;
+  step.branch = rule.MayBranch(step.diameter, terminal, primary_tip) &&
+                random->Uniform() < rule.branch_probability;
+  return step;
+}
+
+// Number of growth behaviors that are not parked, i.e. of elements that still
+// grow in the per-agent path (see GrowthConvergence).
+class ActiveGrowthBehaviors {
+ public:
+  static ActiveGrowthBehaviors* Get() {
+    static ActiveGrowthBehaviors kCounter;
+    return &kCounter;
+  }
+
+  // Thread-safe.
+  void Add(int64_t delta) {
+    count_.fetch_add(delta, std::memory_order_relaxed);
+  }
+  int64_t Count() const { return count_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> count_{0};
+
+  ActiveGrowthBehaviors() {}
+};
+
+// Member of a growth behavior that keeps ActiveGrowthBehaviors up to date:
+// every instance that is not dormant is counted, including the copies
+// BioDynaMo makes with New and NewCopy.
+class GrowthActivity {
+ public:
+  GrowthActivity() { ActiveGrowthBehaviors::Get()->Add(1); }
+  GrowthActivity(const GrowthActivity& other) : dormant_(other.dormant_) {
+    ActiveGrowthBehaviors::Get()->Add(dormant_ ? 0 : 1);
+  }
+  GrowthActivity& operator=(const GrowthActivity& other) {
+    SetDormant(other.dormant_);
+    return *this;
+  }
+  ~GrowthActivity() { ActiveGrowthBehaviors::Get()->Add(dormant_ ? 0 : -1); }
+
+  void SetDormant(bool dormant) {
+    if (dormant != dormant_) {
+      ActiveGrowthBehaviors::Get()->Add(dormant ? -1 : 1);
+      dormant_ = dormant;
+    }
+  }
+
+ private:
+  bool dormant_ = false;
+};
+
+// Dendrite growth behavior following the rule of a growth policy (see
+// ApicalPolicy). All parameters are compile-time constants of the policy, so
+// each specialization is inlined without runtime parameter lookups, and a new
+// cell compartment only needs a new policy. Behaviors are copied to every new
+// element, so they come from a per-thread SlotPool like the elements.
+template <typename TPolicy>
+struct GrowthBehavior : public Behavior, public DormancyObserver {
+  BDM_BEHAVIOR_HEADER(GrowthBehavior, Behavior, 1);
+  GrowthBehavior() {
+    if (TPolicy::kRule.terminal_only) {
+      // the proximal half of a split element is never terminal, so a copy
+      // there would only be allocated to be parked in its first run
+      CopyToNewIf({neuroscience::NewNeuriteExtensionEvent::kUid,
+                   neuroscience::NeuriteBifurcationEvent::kUid,
+                   neuroscience::NeuriteBranchingEvent::kUid,
+                   neuroscience::SideNeuriteExtensionEvent::kUid});
+    } else {
+      AlwaysCopyToNew();
+    }
+  }
+  virtual ~GrowthBehavior() {}
+
+  static void* operator new(size_t size) {
+    return PoolNew<GrowthBehavior>(size);
+  }
+  static void operator delete(void* pointer, size_t size) {
+    PoolDelete<GrowthBehavior>(pointer, size);
+  }
+
+  void Initialize(const NewAgentEvent& event) override {
+    Base::Initialize(event);
+    // only the behavior attached to the neurite extended from the soma keeps
+    // the right to branch if the rule restricts branching to the primary tip
+    can_branch_ = false;
+  }
+
+  void OnPark() override { activity_.SetDormant(true); }
+  void OnWake() override { activity_.SetDormant(false); }
+
+  void Run(Agent* agent) override {
+    constexpr const GrowthRule& rule = TPolicy::kRule;
+
+    auto* dendrite = bdm_static_cast<BasicNeurite*>(agent);
+    if (!rule.Grows(dendrite->GetDiameter(), dendrite->IsTerminal())) {
+      // diameters only shrink and terminals only become non-terminal, so an
+      // element that stopped growing never grows again
+      dendrite->ParkBehavior(this, kWakeOnNewAgentEvent);
+      return;
+    }
+
+    if (!init_) {
+      guide_ = SubstanceField(rule.substance);
+      init_ = true;
+    }
+
+    const auto& position = dendrite->GetPosition();
+    if (dendrite->IsTerminal()) {
+      guide_.DeferRefine(position);
+    }
+    Real3 gradient;
+    guide_.GetGradient(position, &gradient);
+
+    auto random = dendrite->GetStepRandom();
+    auto step = ComputeGrowthStep(rule, dendrite->GetSpringAxis(), gradient,
+                                  dendrite->GetDiameter(),
+                                  dendrite->IsTerminal(), can_branch_, &random);
+
+    dendrite->ElongateTerminalEnd(rule.speed, step.direction);
+    dendrite->SetDiameter(step.diameter);
+    dendrite->UnfreezeNeighbors();
+
+    if (step.branch) {
+      BranchTip(rule, dendrite, &random);
+    }
+  }
+
+ private:
+  bool init_ = false;
+  bool can_branch_ = true;
+  SubstanceField guide_;
+  CountedBehavior counted_;
+  GrowthActivity activity_;
+};
+
+using ApicalDendriteGrowth = GrowthBehavior<ApicalPolicy>;
+using BasalDendriteGrowth = GrowthBehavior<BasalPolicy>;
+
+}  // namespace bdm
+
+#endif  // GROWTH_BEHAVIOR_H_
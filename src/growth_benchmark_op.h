@@ -0,0 +1,119 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GROWTH_BENCHMARK_OP_H_
+#define GROWTH_BENCHMARK_OP_H_
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "biodynamo.h"
+#include "counter_random.h"
+#include "growth_behavior.h"
+#include "growth_rule.h"
+#include "sim_param.h"
+#include "substance_field.h"
+
+namespace bdm {
+
+// This operation measures, once, the cost per tip of a growth step (gradient
+// query, random draws, step direction, thinning and branch decision, see
+// ComputeGrowthStep) of GrowthBehavior<ApicalPolicy> and
+// GrowthBehavior<BasalPolicy>, whose rules are compile-time constants, and of
+// the same rules read from the growth rule table in SimParam at runtime. The
+// tips are random positions and axes inside the simulation space; the results
+// are not written to any agent. All queries run on one thread.
+struct growth_benchmark_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(growth_benchmark_op);
+
+  void operator()() override {
+    if (done_) {
+      return;
+    }
+    done_ = true;
+
+    auto* param = Simulation::GetActive()->GetParam();
+    CounterRandom random(param->random_seed, 0);
+    tips_.resize(kTips);
+    for (auto& tip : tips_) {
+      tip.position =
+          random.UniformArray<3>(param->min_bound, param->max_bound);
+      tip.axis = random.UniformArray<3>(-1, 1);
+      tip.diameter = random.Uniform(0.5, 1.5);
+    }
+
+    const auto& rules = param->Get<SimParam>()->growth_rules;
+    Compare<ApicalPolicy>("apical", rules, kApicalGrowth);
+    Compare<BasalPolicy>("basal", rules, kBasalGrowth);
+  }
+
+ private:
+  struct Tip {
+    Real3 position;
+    Real3 axis;
+    real_t diameter;
+  };
+
+  static constexpr size_t kTips = 1000000;
+  bool done_ = false;
+  std::vector<Tip> tips_;
+
+  // Times the policy against the runtime rule with the given id, if the table
+  // has one.
+  template <typename TPolicy>
+  void Compare(const std::string& name, const std::vector<GrowthRule>& rules,
+               uint8_t id) const {
+    SubstanceField guide(TPolicy::kRule.substance);
+    if (!guide.IsDefined()) {
+      return;
+    }
+    Report(name + ", compile-time rule", guide, []() -> const GrowthRule& {
+      constexpr const GrowthRule& rule = TPolicy::kRule;
+      return rule;
+    });
+    if (id <= rules.size()) {
+      const auto* rule = &rules[id - 1];
+      Report(name + ", runtime rule", guide,
+             [rule]() -> const GrowthRule& { return *rule; });
+    }
+  }
+
+  // Prints the mean time of a growth step per tip under the rule returned by
+  // get_rule.
+  template <typename TGetRule>
+  void Report(const std::string& method, const SubstanceField& guide,
+              TGetRule get_rule) const {
+    auto start = std::chrono::steady_clock::now();
+    // keeps the steps from being optimized away
+    real_t checksum = 0;
+    for (size_t i = 0; i < tips_.size(); i++) {
+      const auto& tip = tips_[i];
+      Real3 gradient;
+      guide.GetGradient(tip.position, &gradient);
+      CounterRandom random(i, 0);
+      auto step = ComputeGrowthStep(get_rule(), tip.axis, gradient,
+                                    tip.diameter, true, true, &random);
+      checksum += step.direction[0] + step.diameter + step.branch;
+    }
+    std::chrono::duration<double, std::nano> duration =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Growth step per tip (" << method
+              << "): " << duration.count() / tips_.size()
+              << " ns (checksum " << checksum << ")" << std::endl;
+  }
+};
+
+}  // namespace bdm
+
+#endif  // GROWTH_BENCHMARK_OP_H_
@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GROWTH_CONE_H_
+#define GROWTH_CONE_H_
+
+#include <cstdint>
+#include <vector>
+#include "basic_neurite.h"
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Structure-of-arrays records of the growing tips (growth cones) of one growth
+// rule. A cone holds everything a growth step of a terminal element needs, so
+// it advances without touching the element. Elongation and thinning are
+// written back to the element (materialized) once a segment is complete, the
+// tip branches or it stops growing; the cone then reloads the element, which
+// mechanics may have moved in the meantime.
+struct GrowthCones {
+  std::vector<AgentUid> uid;
+  std::vector<uint64_t> random_stream;
+  // distal end of the tip
+  std::vector<real_t> pos_x, pos_y, pos_z;
+  // spring axis of the element including the pending elongation
+  std::vector<real_t> axis_x, axis_y, axis_z;
+  // elongation not materialized yet
+  std::vector<real_t> pending_x, pending_y, pending_z;
+  std::vector<real_t> diameter;
+  std::vector<uint8_t> primary_tip;
+  // growth steps per simulation step (see SimParam::max_growth_substeps)
+  std::vector<uint8_t> substeps;
+  // the element changed since the cone read it last
+  std::vector<uint8_t> stale;
+
+  // state of the current step
+  std::vector<real_t> grad_x, grad_y, grad_z;
+  std::vector<real_t> rand_x, rand_y, rand_z;
+  // uniform random number for the branching decision
+  std::vector<real_t> branch_draw;
+  // the tip takes the current substep
+  std::vector<uint8_t> advance;
+  std::vector<uint8_t> materialize;
+  std::vector<uint8_t> branch;
+  // the tip stopped growing
+  std::vector<uint8_t> retire;
+
+  size_t size() const { return uid.size(); }
+
+  // Adds the cone of a terminal element; its state is loaded in the next step.
+  void Add(const BasicNeurite* element) {
+    uid.push_back(element->GetUid());
+    random_stream.push_back(element->GetRandomStream());
+    for (auto* v : {&pos_x, &pos_y, &pos_z, &axis_x, &axis_y, &axis_z,
+                    &pending_x, &pending_y, &pending_z, &diameter}) {
+      v->push_back(0);
+    }
+    primary_tip.push_back(element->IsPrimaryTip());
+    substeps.push_back(1);
+    stale.push_back(true);
+  }
+
+  // Reads the state of the element into cone i.
+  void Load(size_t i, const BasicNeurite* element) {
+    const auto& pos = element->GetMassLocation();
+    const auto& axis = element->GetSpringAxis();
+    pos_x[i] = pos[0];
+    pos_y[i] = pos[1];
+    pos_z[i] = pos[2];
+    axis_x[i] = axis[0];
+    axis_y[i] = axis[1];
+    axis_z[i] = axis[2];
+    diameter[i] = element->GetDiameter();
+    stale[i] = false;
+  }
+
+  // Allocates and clears the state of the current step.
+  void ResetStepState() {
+    size_t n = size();
+    for (auto* v : {&grad_x, &grad_y, &grad_z, &rand_x, &rand_y, &rand_z,
+                    &branch_draw}) {
+      v->resize(n);
+    }
+    for (auto* v : {&advance, &materialize, &branch, &retire}) {
+      v->assign(n, false);
+    }
+  }
+
+  // Removes the cones flagged in `retire`, keeping the order of the others.
+  void RemoveRetired() {
+    size_t kept = 0;
+    for (size_t i = 0; i < size(); i++) {
+      if (retire[i]) {
+        continue;
+      }
+      uid[kept] = uid[i];
+      random_stream[kept] = random_stream[i];
+      for (auto* v : {&pos_x, &pos_y, &pos_z, &axis_x, &axis_y, &axis_z,
+                      &pending_x, &pending_y, &pending_z, &diameter}) {
+        (*v)[kept] = (*v)[i];
+      }
+      primary_tip[kept] = primary_tip[i];
+      substeps[kept] = substeps[i];
+      stale[kept] = stale[i];
+      kept++;
+    }
+    uid.resize(kept);
+    random_stream.resize(kept);
+    for (auto* v : {&pos_x, &pos_y, &pos_z, &axis_x, &axis_y, &axis_z,
+                    &pending_x, &pending_y, &pending_z, &diameter}) {
+      v->resize(kept);
+    }
+    primary_tip.resize(kept);
+    substeps.resize(kept);
+    stale.resize(kept);
+  }
+};
+
+}  // namespace bdm
+
+#endif  // GROWTH_CONE_H_
@@ -0,0 +1,73 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GROWTH_CONVERGENCE_H_
+#define GROWTH_CONVERGENCE_H_
+
+#include <cstdint>
+#include "biodynamo.h"
+#include "dendrite_growth_op.h"
+#include "growth_behavior.h"
+#include "sim_param.h"
+
+namespace bdm {
+
+// Convergence criterion of the growth phase. Growth has converged once no
+// element has grown and no element has been created for convergence_steps
+// consecutive steps. Call it once before every step; it returns true when the
+// phase can end. With batched growth the growing elements are counted by
+// dendrite_growth_op, otherwise the growth behaviors that are not parked are
+// counted (see ActiveGrowthBehaviors; growth behaviors park themselves when
+// they stop, while other behaviors such as TipSecretion may run forever).
+class GrowthConvergence {
+ public:
+  // `growth_op` is the dendrite_growth operation, or nullptr if growth runs
+  // as behaviors.
+  explicit GrowthConvergence(Operation* growth_op) : growth_op_(growth_op) {}
+
+  bool operator()() {
+    auto* sim = Simulation::GetActive();
+    auto steps = sim->GetParam()->Get<SimParam>()->convergence_steps;
+    if (steps == 0) {
+      return false;
+    }
+    auto* rm = sim->GetResourceManager();
+    uint64_t agents = rm->GetNumAgents();
+    bool quiet = agents == last_agents_ && CountGrowing() == 0;
+    quiet_steps_ = quiet ? quiet_steps_ + 1 : 0;
+    last_agents_ = agents;
+    if (quiet_steps_ >= steps) {
+      Log::Info("GrowthConvergence", "Growth converged at step ",
+                sim->GetScheduler()->GetSimulatedSteps());
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  Operation* growth_op_;
+  uint64_t last_agents_ = 0;
+  uint64_t quiet_steps_ = 0;
+
+  uint64_t CountGrowing() const {
+    if (growth_op_ != nullptr) {
+      return growth_op_->GetImplementation<dendrite_growth_op>()
+          ->GetNumGrowing();
+    }
+    return static_cast<uint64_t>(ActiveGrowthBehaviors::Get()->Count());
+  }
+};
+
+}  // namespace bdm
+
+#endif  // GROWTH_CONVERGENCE_H_
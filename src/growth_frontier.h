@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GROWTH_FRONTIER_H_
+#define GROWTH_FRONTIER_H_
+
+#include <algorithm>
+#include <vector>
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Set of neurite elements that may still grow under their growth rule.
+// Elements register themselves when they are created with a rule; the growth
+// operation drops them as soon as the rule no longer applies. Diameters only
+// shrink and terminal elements only become non-terminal, so a dropped element
+// never grows again.
+// Elements are stored by uid because load balancing may move agents in memory.
+// New elements are created from any thread and are therefore collected in
+// per-thread buffers that are merged once per step.
+class GrowthFrontier {
+ public:
+  static GrowthFrontier* Get() {
+    static GrowthFrontier kFrontier;
+    return &kFrontier;
+  }
+
+  // Registers a new growing element. Thread-safe.
+  void Add(const AgentUid& uid) {
+    pending_[ThreadInfo::GetInstance()->GetMyThreadId()].push_back(uid);
+  }
+
+  // Merges the elements registered since the last call and returns the
+  // frontier. Elements merged in earlier calls that were removed from the
+  // simulation since (e.g. by neurite_coarsening_op) are dropped; new elements
+  // are kept even if they are not committed yet. Must not be called
+  // concurrently with Add.
+  std::vector<AgentUid>& Merge() {
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    elements_.erase(std::remove_if(elements_.begin(), elements_.end(),
+                                   [&](const AgentUid& uid) {
+                                     return !rm->ContainsAgent(uid);
+                                   }),
+                    elements_.end());
+    for (auto& pending : pending_) {
+      elements_.insert(elements_.end(), pending.begin(), pending.end());
+      pending.clear();
+    }
+    return elements_;
+  }
+
+  // Returns the elements merged so far. They may include elements that were
+  // removed or stopped growing since the last Merge.
+  const std::vector<AgentUid>& GetElements() const { return elements_; }
+
+ private:
+  std::vector<AgentUid> elements_;
+  std::vector<std::vector<AgentUid>> pending_;
+
+  GrowthFrontier() : pending_(ThreadInfo::GetInstance()->GetMaxThreads()) {}
+};
+
+}  // namespace bdm
+
+#endif  // GROWTH_FRONTIER_H_
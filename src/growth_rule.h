@@ -0,0 +1,148 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef GROWTH_RULE_H_
+#define GROWTH_RULE_H_
+
+#include <cstdint>
+#include "biodynamo.h"
+#include "neuroscience/neuroscience.h"
+
+namespace bdm {
+
+// kAttractant is only defined if neurites secrete it (see TipSecretion).
+enum Substances { kApical, kBasal, kAttractant };
+
+// Ids of growth rules. Id i refers to entry i - 1 of SimParam::growth_rules;
+// the default table holds the apical and the basal rule.
+enum GrowthRuleId : uint8_t { kNoGrowth, kApicalGrowth, kBasalGrowth };
+
+// Parameters of a dendrite growth rule. Every step a growing element is
+// steered along a weighted sum of its current direction, a random direction
+// and the gradient of a guidance substance, elongated and thinned. Terminal
+// elements occasionally branch.
+struct GrowthRule {
+  // guidance substance
+  int substance;
+  // elements at or below this diameter stop growing
+  real_t min_diameter;
+  // only terminal elements grow
+  bool terminal_only;
+
+  real_t gradient_weight;
+  real_t randomness_weight;
+  real_t old_direction_weight;
+  real_t speed;
+  real_t diameter_decrement;
+
+  // bifurcate the tip (true) or grow a side branch (false)
+  bool bifurcate;
+  // only the tip of the neurite extended from the soma may branch
+  bool branch_from_primary_tip_only;
+  // tips at or below this diameter do not branch
+  real_t branch_min_diameter;
+  real_t branch_probability;
+  // diameter of a new side branch
+  real_t branch_diameter;
+
+  // Returns whether an element with this diameter grows this step.
+  constexpr bool Grows(real_t diameter, bool terminal) const {
+    return diameter > min_diameter && (terminal || !terminal_only);
+  }
+
+  // Returns whether a grown element is allowed to draw for a branch.
+  constexpr bool MayBranch(real_t diameter, bool terminal,
+                           bool primary_tip) const {
+    return terminal && diameter > branch_min_diameter &&
+           (primary_tip || !branch_from_primary_tip_only);
+  }
+};
+
+// Growth policies supply the rule of a cell compartment as a compile-time
+// constant, so GrowthBehavior is specialized and inlined for each rule. They
+// also provide the defaults of the growth rule table in SimParam.
+
+// Apical dendrites grow towards substance_apical. Every element above the
+// diameter threshold is thinned, and only the tip of the apical neurite grows
+// side branches.
+struct ApicalPolicy {
+  static constexpr GrowthRule kRule = {
+      kApical,  // substance
+      0.575,    // min_diameter
+      false,    // terminal_only
+      0.06,     // gradient_weight
+      0.3,      // randomness_weight
+      4,        // old_direction_weight
+      100,      // speed
+      0.00071,  // diameter_decrement
+      false,    // bifurcate
+      true,     // branch_from_primary_tip_only
+      0.55,     // branch_min_diameter
+      0.038,    // branch_probability
+      0.65      // branch_diameter
+  };
+};
+
+// Basal dendrites grow towards substance_basal from their tips and bifurcate.
+struct BasalPolicy {
+  static constexpr GrowthRule kRule = {
+      kBasal,   // substance
+      0.75,     // min_diameter
+      true,     // terminal_only
+      0.03,     // gradient_weight
+      0.4,      // randomness_weight
+      6,        // old_direction_weight
+      50,       // speed
+      0.00085,  // diameter_decrement
+      true,     // bifurcate
+      false,    // branch_from_primary_tip_only
+      0,        // branch_min_diameter
+      0.006,    // branch_probability
+      0         // branch_diameter
+  };
+};
+
+// Branches a growing tip according to the rule: either the tip bifurcates, or
+// a side branch grows out roughly perpendicular to it. All directions are
+// drawn from `random`, so branching does not depend on the thread or on the
+// order in which tips branch.
+template <typename TRandom>
+inline void BranchTip(const GrowthRule& rule, NeuriteElement* dendrite,
+                      TRandom* random) {
+  if (rule.bifurcate) {
+    // the geometry of NeuriteElement::Bifurcate(), which draws from the
+    // generator of the calling thread: two branches 60 degrees apart in a
+    // random plane through the axis
+    const auto* param =
+        Simulation::GetActive()->GetParam()->Get<neuroscience::Param>();
+    const auto& axis = dendrite->GetSpringAxis();
+    Real3 plane = Math::Perp3(axis, random->Uniform(0, 1));
+    constexpr real_t kHalfAngle = Math::kPi / 6;
+    real_t diameter = dendrite->GetDiameter();
+    dendrite->Bifurcate(param->neurite_default_actual_length, diameter,
+                        diameter, Math::RotAroundAxis(axis, kHalfAngle, plane),
+                        Math::RotAroundAxis(axis, -kHalfAngle, plane));
+    return;
+  }
+  auto rand_noise = random->template UniformArray<3>(-0.1, 0.1);
+  Real3 branch_direction =
+      Math::Perp3(dendrite->GetUnitaryAxisDirectionVector() + rand_noise,
+                  random->Uniform(0, 1)) +
+      dendrite->GetSpringAxis();
+  auto* branch = dendrite->Branch(branch_direction);
+  branch->SetDiameter(rule.branch_diameter);
+}
+
+}  // namespace bdm
+
+#endif  // GROWTH_RULE_H_
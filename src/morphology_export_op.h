@@ -0,0 +1,60 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef MORPHOLOGY_EXPORT_OP_H_
+#define MORPHOLOGY_EXPORT_OP_H_
+
+#include <sstream>
+#include <string>
+#include "async_writer.h"
+#include "biodynamo.h"
+#include "neuroscience/neuroscience.h"
+
+namespace bdm {
+
+/// Saves the morphology of the neuron in the SWC file format. The morphology
+/// is copied into a buffer and written in the background (see AsyncWriter).
+inline void SaveNeuronMorphology(Simulation& sim,
+                                 const std::string& filename = "neuron.swc") {
+  auto* writer = AsyncWriter::Get();
+  auto* rm = sim.GetResourceManager();
+  // the first soma truncates the file, all others append to it
+  bool first = true;
+  rm->ForEachAgent([&](Agent* agent) {
+    auto* soma = dynamic_cast<neuroscience::NeuronSoma*>(agent);
+    if (soma != nullptr) {
+      std::ostringstream swc;
+      soma->PrintSWC(swc);
+      writer->Write(sim.GetOutputDir() + "/" + filename, swc.str(), !first);
+      first = false;
+    }
+  });
+  writer->Flush();
+}
+
+// This operation saves a snapshot of the morphology to neuron_<step>.swc
+// every time it runs (see SimParam::morphology_interval). The files are
+// written in the background while the simulation continues.
+struct morphology_export_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(morphology_export_op);
+
+  void operator()() override {
+    auto* sim = Simulation::GetActive();
+    auto step = sim->GetScheduler()->GetSimulatedSteps();
+    SaveNeuronMorphology(*sim, "neuron_" + std::to_string(step) + ".swc");
+  }
+};
+
+}  // namespace bdm
+
+#endif  // MORPHOLOGY_EXPORT_OP_H_
@@ -0,0 +1,45 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef MULTIRES_UPDATE_OP_H_
+#define MULTIRES_UPDATE_OP_H_
+
+#include "biodynamo.h"
+#include "sim_param.h"
+#include "sparse_grid.h"
+#include "substance_field.h"
+
+namespace bdm {
+
+// This operation updates the fine level of the multi-resolution substances
+// once all behaviors of the step have run (see MultiResolutionGrid::Update):
+// it refines around the tips that growth behaviors passed to DeferRefine, so
+// every query of a step reads the levels as they were at its beginning, and
+// frees the fine blocks that no tip refined in the last
+// multires_eviction_steps steps. Tips only move forward, so without eviction
+// the fine level would keep every block along the path of every neurite.
+struct multires_update_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(multires_update_op);
+
+  void operator()() override {
+    const auto* sparam =
+        Simulation::GetActive()->GetParam()->Get<SimParam>();
+    auto max_age = sparam->multires_eviction_steps;
+    MultiResolutionSubstances::Get()->ForEach(
+        [&](const MultiResolutionGrid* grid) { grid->Update(max_age); });
+  }
+};
+
+}  // namespace bdm
+
+#endif  // MULTIRES_UPDATE_OP_H_
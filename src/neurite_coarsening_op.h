@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef NEURITE_COARSENING_OP_H_
+#define NEURITE_COARSENING_OP_H_
+
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+#include "basic_neurite.h"
+#include "biodynamo.h"
+#include "growth_rule.h"
+#include "sim_param.h"
+
+namespace bdm {
+
+// This operation merges consecutive neurite elements that stopped growing into
+// longer ones, which reduces the number of agents that contact detection,
+// mechanics, SWC export and visualization have to process.
+// An element is absorbed by its mother if it is the only daughter, has
+// daughters itself (terminal elements are split again by the neuroscience
+// module), is not a synapse anchor, and the joint between both lies within
+// coarsening_tolerance of the straight line from the proximal end of the
+// mother to the distal end of the element. Branch points therefore stay where
+// they are. Merged elements are at most coarsening_max_length long.
+// This is the only operation that removes agents. Removed elements are never
+// terminal, so they are not in a growth cone batch; GrowthFrontier drops them
+// in its next Merge, and their SubstanceWakeList entries are purged.
+struct neurite_coarsening_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(neurite_coarsening_op);
+
+  void operator()() override {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+    auto* ctxt = sim->GetExecutionContext();
+    const auto* sparam = sim->GetParam()->Get<SimParam>();
+
+    std::unordered_set<uint64_t> removed;
+    rm->ForEachAgent([&](Agent* agent) {
+      auto* mother = dynamic_cast<BasicNeurite*>(agent);
+      if (mother == nullptr || removed.count(mother->GetUid()) != 0 ||
+          !mother->IsRetired(sparam->growth_rules)) {
+        return;
+      }
+      while (mother->GetDaughterRight() == nullptr &&
+             mother->GetDaughterLeft() != nullptr) {
+        auto* daughter =
+            dynamic_cast<BasicNeurite*>(mother->GetDaughterLeft().Get());
+        if (daughter == nullptr || !IsMergeable(mother, daughter, sparam)) {
+          break;
+        }
+        Merge(mother, daughter);
+        removed.insert(daughter->GetUid());
+        ctxt->RemoveAgent(daughter->GetUid());
+      }
+    });
+    if (!removed.empty()) {
+      SubstanceWakeList::Get()->Purge([&](const AgentUid& uid) {
+        return removed.count(uid) != 0;
+      });
+    }
+  }
+
+ private:
+  static bool IsMergeable(const BasicNeurite* mother,
+                          const BasicNeurite* daughter,
+                          const SimParam* sparam) {
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    // elements created in this step are not committed yet
+    if (!rm->ContainsAgent(daughter->GetUid()) || daughter->IsTerminal() ||
+        mother->IsSynapseAnchor() || daughter->IsSynapseAnchor() ||
+        !daughter->IsRetired(sparam->growth_rules)) {
+      return false;
+    }
+    const auto& a = mother->GetSpringAxis();
+    Real3 c = a + daughter->GetSpringAxis();
+    real_t length = c.Norm();
+    if (length > sparam->coarsening_max_length || length == 0) {
+      return false;
+    }
+    // distance of the joint from the line through both outer ends
+    real_t deviation = Math::CrossProduct(a, c).Norm() / length;
+    return deviation <= sparam->coarsening_tolerance;
+  }
+
+  // Extends the mother to the distal end of the daughter and hands over the
+  // daughters of the daughter.
+  static void Merge(BasicNeurite* mother, BasicNeurite* daughter) {
+    real_t mother_length = mother->GetActualLength();
+    real_t daughter_length = daughter->GetActualLength();
+    Real3 axis = mother->GetSpringAxis() + daughter->GetSpringAxis();
+    // keeps the volume of both cylinders
+    real_t mother_diameter = mother->GetDiameter();
+    real_t daughter_diameter = daughter->GetDiameter();
+    real_t diameter = std::sqrt(
+        (mother_diameter * mother_diameter * mother_length +
+         daughter_diameter * daughter_diameter * daughter_length) /
+        (mother_length + daughter_length));
+
+    mother->SetRestingLength(mother->GetRestingLength() +
+                             daughter->GetRestingLength());
+    mother->SetSpringAxis(axis);
+    mother->SetActualLength(axis.Norm());
+    mother->SetMassLocation(daughter->GetMassLocation());
+    mother->SetDiameter(diameter);
+
+    mother->SetDaughterLeft(daughter->GetDaughterLeft());
+    mother->SetDaughterRight(daughter->GetDaughterRight());
+    for (auto* grand_daughter : {daughter->GetDaughterLeft().Get(),
+                                 daughter->GetDaughterRight().Get()}) {
+      if (grand_daughter != nullptr) {
+        grand_daughter->SetMother(mother->GetNeuronOrNeuriteAgentPtr());
+      }
+    }
+    mother->UpdateDependentPhysicalVariables();
+  }
+};
+
+}  // namespace bdm
+
+#endif  // NEURITE_COARSENING_OP_H_
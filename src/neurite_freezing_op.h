@@ -0,0 +1,90 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef NEURITE_FREEZING_OP_H_
+#define NEURITE_FREEZING_OP_H_
+
+#include <vector>
+#include "basic_neurite.h"
+#include "basic_neuron.h"
+#include "biodynamo.h"
+#include "sim_param.h"
+
+namespace bdm {
+
+// This operation freezes every neurite subtree in which all elements stopped
+// growing (see BasicNeurite::IsRetired). Frozen elements skip the calculation
+// of mechanical forces, the most expensive part of a step, so late steps only
+// cost what is still growing. Elements are unfrozen when a new agent event
+// involves them, when their mother moves, or when a growing element comes
+// close (BasicNeurite::UnfreezeNeighbors); this operation freezes them again
+// in its next run if their subtree is still finished.
+struct neurite_freezing_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(neurite_freezing_op);
+
+  void operator()() override {
+    auto* sim = Simulation::GetActive();
+    auto* rm = sim->GetResourceManager();
+    const auto& rules = sim->GetParam()->Get<SimParam>()->growth_rules;
+
+    std::vector<BasicNeurite*> preorder;
+    std::vector<BasicNeurite*> stack;
+    rm->ForEachAgent([&](Agent* agent) {
+      auto* soma = dynamic_cast<basic_neuron*>(agent);
+      if (soma == nullptr) {
+        return;
+      }
+      // collect the tree in pre-order, so that every element is visited after
+      // its daughters when the list is traversed backwards
+      preorder.clear();
+      for (const auto& neurite : soma->GetDaughters()) {
+        Push(neurite.Get(), &stack);
+      }
+      while (!stack.empty()) {
+        auto* element = stack.back();
+        stack.pop_back();
+        preorder.push_back(element);
+        Push(element->GetDaughterLeft().Get(), &stack);
+        Push(element->GetDaughterRight().Get(), &stack);
+      }
+      for (auto it = preorder.rbegin(); it != preorder.rend(); ++it) {
+        auto* element = *it;
+        if (element->IsRetired(rules) &&
+            IsFrozen(element->GetDaughterLeft().Get()) &&
+            IsFrozen(element->GetDaughterRight().Get())) {
+          element->Freeze();
+        }
+      }
+    });
+  }
+
+ private:
+  static void Push(NeuriteElement* element, std::vector<BasicNeurite*>* stack) {
+    if (auto* basic = dynamic_cast<BasicNeurite*>(element)) {
+      stack->push_back(basic);
+    }
+  }
+
+  // Missing daughters count as frozen, other neurite types never freeze.
+  static bool IsFrozen(NeuriteElement* daughter) {
+    if (daughter == nullptr) {
+      return true;
+    }
+    auto* basic = dynamic_cast<BasicNeurite*>(daughter);
+    return basic != nullptr && basic->IsFrozen();
+  }
+};
+
+}  // namespace bdm
+
+#endif  // NEURITE_FREEZING_OP_H_
@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef PACKED_STORAGE_H_
+#define PACKED_STORAGE_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "biodynamo.h"
+#include "sim_param.h"
+
+namespace bdm {
+
+// Precision at which grid samples are stored. Computations use real_t.
+enum class StoragePrecision : uint8_t {
+  kReal,
+  kFloat,
+  // 16 bit fixed point between the minimum and maximum of the stored values
+  kQuantized16
+};
+
+// Returns the storage precision of the substance given in
+// SimParam::substance_precision ("real", "float" or "16bit"). Substances
+// without an entry are stored as real_t.
+inline StoragePrecision GetStoragePrecision(int substance) {
+  const auto& precisions =
+      Simulation::GetActive()->GetParam()->Get<SimParam>()->substance_precision;
+  if (substance < 0 || static_cast<size_t>(substance) >= precisions.size()) {
+    return StoragePrecision::kReal;
+  }
+  const auto& precision = precisions[substance];
+  if (precision == "float") {
+    return StoragePrecision::kFloat;
+  } else if (precision == "16bit") {
+    return StoragePrecision::kQuantized16;
+  } else if (precision != "real") {
+    Log::Fatal("GetStoragePrecision", "Unknown precision '", precision,
+               "' of substance ", substance);
+  }
+  return StoragePrecision::kReal;
+}
+
+// Calls f with a value of the sample type of the precision: real_t, float or
+// uint16_t for kQuantized16. Grids resolve the precision this way once per
+// query or block and read their PackedArray of that sample type, e.g.
+//   DispatchPrecision(precision, [&](auto sample) {
+//     using TSample = decltype(sample);
+//     ...
+//   });
+template <typename TFunction>
+inline auto DispatchPrecision(StoragePrecision precision, TFunction&& f) {
+  switch (precision) {
+    case StoragePrecision::kFloat:
+      return f(float());
+    case StoragePrecision::kQuantized16:
+      return f(uint16_t());
+    default:
+      return f(real_t());
+  }
+}
+
+// Array of n values of kComponents components each, stored interleaved as
+// TSample (see DispatchPrecision). 16 bit samples are fixed point between the
+// minimum and maximum of their component. The sample type is known at compile
+// time, so reading a value does not depend on the precision.
+template <typename TSample, size_t kComponents>
+class PackedArray {
+ public:
+  PackedArray() {}
+  explicit PackedArray(
+      const std::array<std::vector<real_t>, kComponents>& components) {
+    size_t n = components[0].size();
+    samples_.resize(n * kComponents);
+    for (size_t c = 0; c < kComponents; c++) {
+      const auto& values = components[c];
+      if (kQuantized && n != 0) {
+        auto range = std::minmax_element(values.begin(), values.end());
+        offset_[c] = *range.first;
+        scale_[c] = (*range.second - offset_[c]) / 65535;
+      }
+      for (size_t i = 0; i < n; i++) {
+        samples_[i * kComponents + c] = Encode(values[i], c);
+      }
+    }
+  }
+
+  // Returns component c of value i.
+  real_t Get(size_t i, size_t c) const {
+    auto sample = samples_[i * kComponents + c];
+    if (kQuantized) {
+      return offset_[c] + sample * scale_[c];
+    }
+    return sample;
+  }
+
+ private:
+  static constexpr bool kQuantized = std::is_same<TSample, uint16_t>::value;
+
+  std::vector<TSample> samples_;
+  std::array<real_t, kComponents> offset_ = {};
+  std::array<real_t, kComponents> scale_ = {};
+
+  TSample Encode(real_t value, size_t c) const {
+    if (!kQuantized) {
+      return static_cast<TSample>(value);
+    }
+    if (scale_[c] == 0) {
+      return 0;
+    }
+    return static_cast<TSample>(std::lround((value - offset_[c]) / scale_[c]));
+  }
+};
+
+}  // namespace bdm
+
+#endif  // PACKED_STORAGE_H_
@@ -0,0 +1,189 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef POPULATION_H_
+#define POPULATION_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "biodynamo.h"
+#include "counter_random.h"
+#include "sim_param.h"
+
+namespace bdm {
+
+// Returns the corner of the population volume given as a vector of three
+// coordinates in SimParam.
+inline Real3 GetPopulationCorner(const std::vector<real_t>& corner) {
+  if (corner.size() != 3) {
+    Log::Fatal("GetPopulationCorner",
+               "population_min and population_max need three coordinates");
+  }
+  return {corner[0], corner[1], corner[2]};
+}
+
+// Places somata on the points of a grid with the given spacing, filling the
+// volume x first, then y, then z.
+inline std::vector<Real3> PlaceSomataOnGrid(uint64_t num, const Real3& min,
+                                            const Real3& max, real_t spacing) {
+  if (spacing <= 0) {
+    Log::Fatal("PlaceSomataOnGrid", "soma_spacing must be positive");
+  }
+  std::array<uint64_t, 3> points;
+  for (int d = 0; d < 3; d++) {
+    points[d] = static_cast<uint64_t>((max[d] - min[d]) / spacing) + 1;
+  }
+  if (points[0] * points[1] * points[2] < num) {
+    Log::Fatal("PlaceSomataOnGrid", "The grid only holds ",
+               points[0] * points[1] * points[2], " of ", num, " somata");
+  }
+  std::vector<Real3> positions(num);
+#pragma omp parallel for
+  for (uint64_t i = 0; i < num; i++) {
+    uint64_t x = i % points[0];
+    uint64_t y = (i / points[0]) % points[1];
+    uint64_t z = i / (points[0] * points[1]);
+    positions[i] = {min[0] + x * spacing, min[1] + y * spacing,
+                    min[2] + z * spacing};
+  }
+  return positions;
+}
+
+// Places somata uniformly at random. Position i is drawn from its own
+// counter-based stream, so the result does not depend on the number of
+// threads.
+inline std::vector<Real3> PlaceSomataUniformly(uint64_t num, const Real3& min,
+                                               const Real3& max,
+                                               uint64_t stream) {
+  std::vector<Real3> positions(num);
+#pragma omp parallel for
+  for (uint64_t i = 0; i < num; i++) {
+    CounterRandom random(stream, i);
+    for (int d = 0; d < 3; d++) {
+      positions[i][d] = random.Uniform(min[d], max[d]);
+    }
+  }
+  return positions;
+}
+
+// Places somata uniformly at random, rejecting candidates closer than
+// min_distance to a soma placed before (Poisson-disk sampling by dart
+// throwing). Placed somata are binned into cells of edge min_distance, so a
+// candidate is only compared with the somata of its 27 neighboring cells.
+inline std::vector<Real3> PlaceSomataPoissonDisk(uint64_t num,
+                                                 const Real3& min,
+                                                 const Real3& max,
+                                                 real_t min_distance,
+                                                 uint64_t stream) {
+  if (min_distance <= 0) {
+    Log::Fatal("PlaceSomataPoissonDisk", "soma_spacing must be positive");
+  }
+  std::array<int64_t, 3> cells;
+  for (int d = 0; d < 3; d++) {
+    cells[d] = std::max<int64_t>(
+        1, static_cast<int64_t>(std::ceil((max[d] - min[d]) / min_distance)));
+  }
+  std::vector<std::vector<uint64_t>> grid(cells[0] * cells[1] * cells[2]);
+  auto cell_of = [&](const Real3& position, int d) {
+    auto c = static_cast<int64_t>((position[d] - min[d]) / min_distance);
+    return std::min(c, cells[d] - 1);
+  };
+
+  std::vector<Real3> positions;
+  positions.reserve(num);
+  const real_t squared_min_distance = min_distance * min_distance;
+  const uint64_t max_candidates = 100 * num;
+  for (uint64_t candidate = 0;
+       positions.size() < num && candidate < max_candidates; candidate++) {
+    CounterRandom random(stream, candidate);
+    Real3 position;
+    std::array<int64_t, 3> cell;
+    for (int d = 0; d < 3; d++) {
+      position[d] = random.Uniform(min[d], max[d]);
+      cell[d] = cell_of(position, d);
+    }
+
+    bool accepted = true;
+    for (int64_t z = std::max<int64_t>(0, cell[2] - 1);
+         accepted && z <= std::min(cells[2] - 1, cell[2] + 1); z++) {
+      for (int64_t y = std::max<int64_t>(0, cell[1] - 1);
+           accepted && y <= std::min(cells[1] - 1, cell[1] + 1); y++) {
+        for (int64_t x = std::max<int64_t>(0, cell[0] - 1);
+             accepted && x <= std::min(cells[0] - 1, cell[0] + 1); x++) {
+          for (auto j : grid[(z * cells[1] + y) * cells[0] + x]) {
+            real_t squared_distance = 0;
+            for (int d = 0; d < 3; d++) {
+              real_t delta = positions[j][d] - position[d];
+              squared_distance += delta * delta;
+            }
+            if (squared_distance < squared_min_distance) {
+              accepted = false;
+              break;
+            }
+          }
+        }
+      }
+    }
+    if (accepted) {
+      grid[(cell[2] * cells[1] + cell[1]) * cells[0] + cell[0]].push_back(
+          positions.size());
+      positions.push_back(position);
+    }
+  }
+  if (positions.size() < num) {
+    Log::Fatal("PlaceSomataPoissonDisk", "Only ", positions.size(), " of ",
+               num, " somata fit into the volume at the given spacing");
+  }
+  return positions;
+}
+
+// Returns the soma positions of the neuron population described by the
+// parameters (soma_placement, num_neurons, population_min, population_max,
+// soma_spacing).
+inline std::vector<Real3> PlaceSomata(const SimParam* sparam, uint64_t seed) {
+  auto min = GetPopulationCorner(sparam->population_min);
+  auto max = GetPopulationCorner(sparam->population_max);
+  auto num = sparam->num_neurons;
+  auto stream = MixRandomStream(seed, num);
+  if (sparam->soma_placement == "grid") {
+    return PlaceSomataOnGrid(num, min, max, sparam->soma_spacing);
+  } else if (sparam->soma_placement == "uniform") {
+    return PlaceSomataUniformly(num, min, max, stream);
+  } else if (sparam->soma_placement == "poisson_disk") {
+    return PlaceSomataPoissonDisk(num, min, max, sparam->soma_spacing, stream);
+  }
+  Log::Fatal("PlaceSomata", "Unknown soma placement '",
+             sparam->soma_placement, "'");
+  return {};
+}
+
+// Returns the cell type of neuron i of the population (see
+// SimParam::population_cell_types).
+inline const CellType& GetCellType(const SimParam* sparam, uint64_t neuron) {
+  const auto& types = sparam->population_cell_types;
+  if (types.empty()) {
+    Log::Fatal("GetCellType", "population_cell_types must not be empty");
+  }
+  auto type = types[neuron % types.size()];
+  if (type >= sparam->cell_types.size()) {
+    Log::Fatal("GetCellType", "Undefined cell type ", type);
+  }
+  return sparam->cell_types[type];
+}
+
+}  // namespace bdm
+
+#endif  // POPULATION_H_
@@ -0,0 +1,119 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SECRETION_H_
+#define SECRETION_H_
+
+#include <vector>
+#include "allocation_counter.h"
+#include "basic_neurite.h"
+#include "biodynamo.h"
+#include "neuroscience/neuroscience.h"
+#include "slot_pool.h"
+#include "substance_sources.h"
+
+namespace bdm {
+
+// Amount of a substance added at a position.
+struct SecretionRecord {
+  int substance;
+  Real3 position;
+  real_t amount;
+};
+
+// Secretions of the current step. Agents emit from any thread into per-thread
+// buffers, which secretion_op deposits into the diffusion grids once per step,
+// instead of every agent writing to the grids itself.
+class SecretionBuffers {
+ public:
+  static SecretionBuffers* Get() {
+    static SecretionBuffers kBuffers;
+    return &kBuffers;
+  }
+
+  // Adds the amount of the substance at the position. Thread-safe.
+  void Emit(int substance, const Real3& position, real_t amount) {
+    buffers_[ThreadInfo::GetInstance()->GetMyThreadId()].push_back(
+        {substance, position, amount});
+  }
+
+  // Returns and clears the secretions emitted since the last call. Must not
+  // be called concurrently with Emit.
+  std::vector<SecretionRecord> Take() {
+    std::vector<SecretionRecord> records;
+    for (auto& buffer : buffers_) {
+      records.insert(records.end(), buffer.begin(), buffer.end());
+      buffer.clear();
+    }
+    return records;
+  }
+
+ private:
+  std::vector<std::vector<SecretionRecord>> buffers_;
+
+  SecretionBuffers() : buffers_(ThreadInfo::GetInstance()->GetMaxThreads()) {}
+};
+
+// Secretion of a substance from the growing tips of a neurite: every step a
+// terminal element emits rate * dt at its distal end. Elements stop secreting
+// when they are no longer terminal, which is permanent, so the behavior is
+// parked there. Like growth behaviors, it is allocated from a SlotPool.
+struct TipSecretion : public Behavior {
+  BDM_BEHAVIOR_HEADER(TipSecretion, Behavior, 1);
+  TipSecretion() {}
+  TipSecretion(int substance, real_t rate)
+      : substance_(substance), rate_(rate) {
+    // new tips are created by extension, bifurcation and branching; the
+    // proximal half of a split element is never terminal
+    CopyToNewIf({neuroscience::NewNeuriteExtensionEvent::kUid,
+                 neuroscience::NeuriteBifurcationEvent::kUid,
+                 neuroscience::NeuriteBranchingEvent::kUid,
+                 neuroscience::SideNeuriteExtensionEvent::kUid});
+    SubstanceSources::Get()->Add(substance);
+  }
+  virtual ~TipSecretion() {}
+
+  static void* operator new(size_t size) {
+    return PoolNew<TipSecretion>(size);
+  }
+  static void operator delete(void* pointer, size_t size) {
+    PoolDelete<TipSecretion>(pointer, size);
+  }
+
+  void Initialize(const NewAgentEvent& event) override {
+    Base::Initialize(event);
+    auto* other = bdm_static_cast<TipSecretion*>(event.existing_behavior);
+    substance_ = other->substance_;
+    rate_ = other->rate_;
+  }
+
+  void Run(Agent* agent) override {
+    auto* neurite = bdm_static_cast<BasicNeurite*>(agent);
+    if (!neurite->IsTerminal()) {
+      neurite->ParkBehavior(this, kWakeOnNewAgentEvent);
+      return;
+    }
+    auto dt = Simulation::GetActive()->GetParam()->simulation_time_step;
+    SecretionBuffers::Get()->Emit(substance_, neurite->GetMassLocation(),
+                                  rate_ * dt);
+  }
+
+ private:
+  int substance_ = 0;
+  real_t rate_ = 0;
+  CountedBehavior counted_;
+};
+
+}  // namespace bdm
+
+#endif  // SECRETION_H_
@@ -0,0 +1,94 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SECRETION_OP_H_
+#define SECRETION_OP_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "basic_neurite.h"
+#include "biodynamo.h"
+#include "secretion.h"
+
+namespace bdm {
+
+// This operation deposits the secretions emitted during the step (see
+// SecretionBuffers) into the diffusion grids. The records of a substance are
+// mapped to grid boxes, sorted by box and summed, so every box is written
+// once, and the boxes are written in parallel without conflicts. Dormant
+// behaviors waiting for a changed substance are woken afterwards.
+struct secretion_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(secretion_op);
+
+  void operator()() override {
+    auto records = SecretionBuffers::Get()->Take();
+    if (records.empty()) {
+      return;
+    }
+    std::sort(records.begin(), records.end(),
+              [](const SecretionRecord& a, const SecretionRecord& b) {
+                return a.substance < b.substance;
+              });
+    auto* rm = Simulation::GetActive()->GetResourceManager();
+    size_t begin = 0;
+    while (begin < records.size()) {
+      int substance = records[begin].substance;
+      size_t end = begin;
+      while (end < records.size() && records[end].substance == substance) {
+        end++;
+      }
+      auto* grid = rm->GetDiffusionGrid(substance);
+      if (grid == nullptr) {
+        Log::Fatal("secretion_op", "Substance ", substance,
+                   " is secreted but has no diffusion grid");
+      }
+      Deposit(grid, &records[begin], end - begin);
+      WakeOnSubstanceChange(substance);
+      begin = end;
+    }
+  }
+
+ private:
+  // box index and amount of every record, reused between steps
+  std::vector<std::pair<size_t, real_t>> deposits_;
+
+  void Deposit(DiffusionGrid* grid, const SecretionRecord* records, size_t n) {
+    deposits_.resize(n);
+#pragma omp parallel for
+    for (size_t i = 0; i < n; i++) {
+      deposits_[i] = {grid->GetBoxIndex(records[i].position),
+                      records[i].amount};
+    }
+    std::sort(deposits_.begin(), deposits_.end());
+
+    // sum the amounts of each box into its first record
+    size_t boxes = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (boxes != 0 && deposits_[boxes - 1].first == deposits_[i].first) {
+        deposits_[boxes - 1].second += deposits_[i].second;
+      } else {
+        deposits_[boxes++] = deposits_[i];
+      }
+    }
+
+#pragma omp parallel for
+    for (size_t i = 0; i < boxes; i++) {
+      grid->ChangeConcentrationBy(deposits_[i].first, deposits_[i].second);
+    }
+  }
+};
+
+}  // namespace bdm
+
+#endif  // SECRETION_OP_H_
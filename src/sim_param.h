@@ -0,0 +1,149 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SIM_PARAM_H_
+#define SIM_PARAM_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "biodynamo.h"
+#include "cell_type.h"
+#include "growth_rule.h"
+
+namespace bdm {
+
+// Parameters of this simulation, read from the "bdm::SimParam" section of
+// bdm.json.
+struct SimParam : public ParamGroup {
+  BDM_PARAM_GROUP_HEADER(SimParam, 1);
+
+  // Grow dendrites with dendrite_growth_op, which advances all growing
+  // elements in one batch, instead of with per-agent growth behaviors.
+  bool batched_growth = true;
+
+  // Number of simulated steps. The simulation runs in phases (see
+  // simulation_phase.h): neurites grow for all but the last detection_steps
+  // steps, in which mechanics, diffusion and growth are off and only synapses
+  // are detected.
+  uint64_t simulation_steps = 500;
+  uint64_t detection_steps = 1;
+  // The growth phase ends early once no element grew or was created for
+  // convergence_steps consecutive steps (see GrowthConvergence); 0 disables
+  // this.
+  uint64_t convergence_steps = 20;
+  // Synapses are formed from synapse_start_step on, every synapse_frequency
+  // steps of the detection phase (see synapse_op). A negative start step
+  // counts from the end, so -1 is the last step.
+  int64_t synapse_start_step = -1;
+  uint64_t synapse_frequency = 1;
+
+  // Representation of the static guidance substances (see
+  // substance_field.h): "analytic" evaluates them in closed form, "sparse"
+  // samples them on grid blocks of sparse_box_length boxes that are only
+  // allocated where neurites query them, "multires" samples them on coarse
+  // blocks everywhere and on fine blocks around growing tips, and "dense"
+  // uses diffusion grids. Fine blocks that were not refined for
+  // multires_eviction_steps steps are freed (0 keeps them).
+  std::string substance_representation = "analytic";
+  real_t sparse_box_length = 10;
+  real_t multires_coarse_box_length = 40;
+  real_t multires_fine_box_length = 5;
+  uint64_t multires_eviction_steps = 10;
+  // The concentrations of the diffusion grids never change after their
+  // initialization, so their gradients are precomputed once (see
+  // gradient_grid.h). Substances with a source, such as the attractant, are
+  // never precomputed.
+  bool precompute_gradients = true;
+  // Storage precision of the sparse and precomputed gradient grids of each
+  // substance, indexed by substance id (see packed_storage.h): "real",
+  // "float" or "16bit". Values are still interpolated in real_t.
+  std::vector<std::string> substance_precision = {"real", "real"};
+  // Log how many gradient queries per second each way of evaluating the
+  // guidance substances answers (see gradient_benchmark_op).
+  bool benchmark_gradients = false;
+  // Log the cost per tip of a growth step with the compile-time rules of the
+  // growth policies and with the runtime rule table (see growth_benchmark_op).
+  bool benchmark_growth = false;
+  // Remove the diffusion operation from the schedule while no substance
+  // diffuses, decays or has a source (see constant_substance_op).
+  bool skip_constant_diffusion = true;
+  // Growing tips secrete substance_attractant at this rate (see
+  // TipSecretion); 0 disables secretion. The attractant diffuses and decays
+  // on a diffusion grid. Growth rules follow it if their substance is 2.
+  real_t secretion_rate = 0;
+  real_t attractant_diffusion = 0.5;
+  real_t attractant_decay = 0.1;
+
+  // Neuron population (see population.h). Somata are placed on a "grid" with
+  // soma_spacing between points, "uniform"ly at random, or at random at least
+  // soma_spacing apart ("poisson_disk") inside the box spanned by
+  // population_min and population_max.
+  std::string soma_placement = "grid";
+  uint64_t num_neurons = 3;
+  std::vector<real_t> population_min = {150, 75, 0};
+  std::vector<real_t> population_max = {150, 125, 0};
+  real_t soma_spacing = 25;
+  // Cell types of the population (see cell_type.h). Neuron i is of type
+  // population_cell_types[i % population_cell_types.size()], so {0, 0, 1}
+  // makes every third neuron a neuron of type 1.
+  std::vector<CellType> cell_types = {PyramidalCellType()};
+  std::vector<uint64_t> population_cell_types = {0};
+
+  // Growth rule table used by dendrite_growth_op; a neurite following rule id
+  // i (see GrowthRuleId) grows with entry i - 1. Growth behaviors use the
+  // compile-time rules of their policy instead.
+  std::vector<GrowthRule> growth_rules = {ApicalPolicy::kRule,
+                                          BasalPolicy::kRule};
+
+  // dendrite_growth_op writes the elongation of a growing tip to its neurite
+  // element once it reaches this length (0 writes it every step).
+  real_t growth_cone_segment_length = 2;
+
+  // Adaptive growth: a tip with no other element ahead of it within
+  // crowding_radius takes up to max_growth_substeps growth steps per
+  // simulation step, and writes longer elements; crowded tips refine down to
+  // one step (1 disables adaptive growth). With the uniform grid environment
+  // crowding_radius is capped at its box length. simulation_steps stays an
+  // upper bound: tips that take several steps reach their final size sooner,
+  // and the growth phase ends once growth converged (see convergence_steps).
+  uint32_t max_growth_substeps = 1;
+  real_t crowding_radius = 10;
+
+  // Merge consecutive elements that stopped growing every coarsening_interval
+  // steps (0 disables) if their joint deviates at most coarsening_tolerance
+  // from a straight line and the merged element is at most
+  // coarsening_max_length long (see neurite_coarsening_op).
+  uint32_t coarsening_interval = 50;
+  real_t coarsening_tolerance = 0.05;
+  real_t coarsening_max_length = 20;
+
+  // Freeze neurite subtrees whose elements all stopped growing every
+  // freeze_interval steps (0 disables; see neurite_freezing_op). Growing
+  // elements unfreeze elements whose mass location is closer than
+  // unfreeze_distance. With the uniform grid environment the distance is
+  // capped at its box length, which is about the size of the largest agent.
+  uint32_t freeze_interval = 10;
+  real_t unfreeze_distance = 10;
+
+  // Write the number of agents and behaviors allocated in every step to
+  // allocations.csv in the output directory (see allocation_report_op).
+  bool report_allocations = false;
+  // Save a snapshot of the morphology every morphology_interval steps of the
+  // growth phase (see morphology_export_op); 0 disables the snapshots.
+  uint64_t morphology_interval = 0;
+};
+
+}  // namespace bdm
+
+#endif  // SIM_PARAM_H_
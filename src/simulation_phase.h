@@ -0,0 +1,168 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SIMULATION_PHASE_H_
+#define SIMULATION_PHASE_H_
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "biodynamo.h"
+
+namespace bdm {
+
+// A stage of the simulation: an optional action followed by at most `steps`
+// steps in which only the phase operations listed in `ops` run (see
+// PhasePipeline).
+struct SimulationPhase {
+  std::string name;
+  uint64_t steps;
+  std::vector<std::string> ops;
+  // runs once at the beginning of the phase
+  std::function<void()> action;
+  // checked before every step; ends the phase early once it returns true
+  std::function<bool()> converged;
+};
+
+// Runs the simulation as a sequence of phases, so each stage only pays for
+// the operations it needs. Phase operations are scheduled in the phases that
+// list them and unscheduled in all others; operations not registered here run
+// in every phase. Operations may also be suspended independently of the phases
+// (see Suspend). The wall time of every phase is printed.
+class PhasePipeline {
+ public:
+  explicit PhasePipeline(Scheduler* scheduler) : scheduler_(scheduler) {}
+
+  // Registers a new operation, which is not yet scheduled, as phase operation.
+  void AddOp(Operation* op, OpType type = kSchedule) {
+    ops_[op->name_].push_back({op, type, false, false});
+  }
+
+  // Registers the scheduled operations with the given name, e.g. the
+  // BioDynaMo operations "mechanical forces" or "diffusion", as phase
+  // operations. If there are none, the operations of the first alias that has
+  // any are registered under the name instead, since BioDynaMo renamed some
+  // of its operations. Warns if no operation is found.
+  void AddScheduledOps(const std::string& name,
+                       const std::vector<std::string>& aliases = {}) {
+    auto ops = scheduler_->GetOps(name);
+    for (size_t i = 0; ops.empty() && i < aliases.size(); i++) {
+      ops = scheduler_->GetOps(aliases[i]);
+    }
+    if (ops.empty()) {
+      Log::Warning("PhasePipeline", "No scheduled operation named '", name,
+                   "'; phases cannot switch it");
+    }
+    auto& entry = ops_[name];
+    for (auto* op : ops) {
+      entry.push_back({op, kSchedule, true, false});
+    }
+  }
+
+  // Keeps the phase operations with the given name unscheduled, also in the
+  // phases that list them, until Resume is called. Returns false if there are
+  // no such operations.
+  bool Suspend(const std::string& name) { return SetSuspended(name, true); }
+  bool Resume(const std::string& name) { return SetSuspended(name, false); }
+
+  void AddPhase(const SimulationPhase& phase) { phases_.push_back(phase); }
+
+  void Run() {
+    for (const auto& phase : phases_) {
+      for (const auto& name : phase.ops) {
+        if (ops_.find(name) == ops_.end()) {
+          Log::Warning("PhasePipeline", "Phase ", phase.name,
+                       " lists the unknown operation '", name, "'");
+        }
+      }
+      current_ = &phase;
+      auto start = std::chrono::steady_clock::now();
+      if (phase.action) {
+        phase.action();
+      }
+      auto first_step = scheduler_->GetSimulatedSteps();
+      if (phase.steps != 0) {
+        Activate(phase);
+        if (phase.converged) {
+          auto end = first_step + phase.steps;
+          scheduler_->SimulateUntil([&]() {
+            return scheduler_->GetSimulatedSteps() >= end || phase.converged();
+          });
+        } else {
+          scheduler_->Simulate(phase.steps);
+        }
+      }
+      std::chrono::duration<double> seconds =
+          std::chrono::steady_clock::now() - start;
+      std::cout << "Phase " << phase.name << ": "
+                << scheduler_->GetSimulatedSteps() - first_step << " steps in "
+                << seconds.count() << " s" << std::endl;
+    }
+    current_ = nullptr;
+  }
+
+ private:
+  struct PhaseOp {
+    Operation* op;
+    OpType type;
+    bool scheduled;
+    bool suspended;
+  };
+
+  Scheduler* scheduler_;
+  // phase that is running, if any
+  const SimulationPhase* current_ = nullptr;
+  // phase operations by name
+  std::unordered_map<std::string, std::vector<PhaseOp>> ops_;
+  std::vector<SimulationPhase> phases_;
+
+  // Schedules the operations of the phase and unschedules the others.
+  void Activate(const SimulationPhase& phase) {
+    for (auto& entry : ops_) {
+      bool active = false;
+      for (const auto& name : phase.ops) {
+        active = active || name == entry.first;
+      }
+      for (auto& op : entry.second) {
+        active = active && !op.suspended;
+        if (active && !op.scheduled) {
+          scheduler_->ScheduleOp(op.op, op.type);
+        } else if (!active && op.scheduled) {
+          scheduler_->UnscheduleOp(op.op);
+        }
+        op.scheduled = active;
+      }
+    }
+  }
+
+  bool SetSuspended(const std::string& name, bool suspended) {
+    auto it = ops_.find(name);
+    if (it == ops_.end()) {
+      return false;
+    }
+    for (auto& op : it->second) {
+      op.suspended = suspended;
+    }
+    if (current_ != nullptr && current_->steps != 0) {
+      Activate(*current_);
+    }
+    return true;
+  }
+};
+
+}  // namespace bdm
+
+#endif  // SIMULATION_PHASE_H_
@@ -0,0 +1,119 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SLOT_POOL_H_
+#define SLOT_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+#include "allocation_counter.h"
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Pool of memory slots of kSize bytes with one free list per thread, so the
+// neurite elements and behaviors created in parallel during growth do not
+// contend on the general heap. Slots are carved from chunks of kSlotsPerChunk
+// slots; a freed slot goes to the free list of the freeing thread, which is
+// correct since all slots have the same size. Chunks are kept until the end
+// of the program, so the pool holds at most the peak number of objects of each
+// thread.
+template <size_t kSize>
+class SlotPool {
+ public:
+  static SlotPool* Get() {
+    static SlotPool kPool;
+    return &kPool;
+  }
+
+  // Thread-safe.
+  void* Allocate() {
+    auto& list = lists_[ThreadInfo::GetInstance()->GetMyThreadId()];
+    if (list.free == nullptr) {
+      Refill(&list);
+    }
+    auto* slot = list.free;
+    list.free = slot->next;
+    return slot;
+  }
+
+  // Thread-safe.
+  void Free(void* pointer) {
+    auto& list = lists_[ThreadInfo::GetInstance()->GetMyThreadId()];
+    auto* slot = static_cast<Slot*>(pointer);
+    slot->next = list.free;
+    list.free = slot;
+  }
+
+ private:
+  static constexpr size_t kSlotsPerChunk = 1024;
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+  union Slot {
+    Slot* next;
+    alignas(kAlignment) char storage[kSize];
+  };
+
+  // one cache line per thread, so threads do not share the list heads
+  struct alignas(64) FreeList {
+    Slot* free = nullptr;
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+  };
+  std::vector<FreeList> lists_;
+
+  SlotPool() : lists_(ThreadInfo::GetInstance()->GetMaxThreads()) {}
+
+  static void Refill(FreeList* list) {
+    list->chunks.emplace_back(new Slot[kSlotsPerChunk]);
+    auto* chunk = list->chunks.back().get();
+    for (size_t i = 0; i < kSlotsPerChunk; i++) {
+      chunk[i].next = i + 1 < kSlotsPerChunk ? &chunk[i + 1] : list->free;
+    }
+    list->free = chunk;
+    AllocationCounter::Get()->AddChunk();
+  }
+};
+
+// Class-specific allocation functions of type T. Objects of exactly T come
+// from the SlotPool of its size; objects of derived types, which are larger,
+// from the general heap. Declare them in T itself, as
+//   static void* operator new(size_t size) { return PoolNew<T>(size); }
+//   static void operator delete(void* p, size_t size) {
+//     PoolDelete<T>(p, size);
+//   }
+// so they hide the allocation functions of the base classes.
+template <typename T>
+inline void* PoolNew(size_t size) {
+  if (size != sizeof(T)) {
+    return ::operator new(size);
+  }
+  return SlotPool<sizeof(T)>::Get()->Allocate();
+}
+
+template <typename T>
+inline void PoolDelete(void* pointer, size_t size) {
+  if (pointer == nullptr) {
+    return;
+  }
+  if (size != sizeof(T)) {
+    ::operator delete(pointer);
+    return;
+  }
+  SlotPool<sizeof(T)>::Get()->Free(pointer);
+}
+
+}  // namespace bdm
+
+#endif  // SLOT_POOL_H_
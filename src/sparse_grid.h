@@ -0,0 +1,414 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SPARSE_GRID_H_
+#define SPARSE_GRID_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "biodynamo.h"
+#include "packed_storage.h"
+
+namespace bdm {
+
+// Static substance sampled on a grid that is only allocated where it is used.
+// The space is divided into blocks of kBlockSize^3 boxes. A block is
+// materialized the first time a query touches it: the initializer is sampled
+// at the centers of its boxes, and the gradient at each center is computed
+// from central differences of the initializer. Queries interpolate both
+// trilinearly between box centers, like GradientGrid. Samples are stored at the
+// given precision; 16 bit samples are quantized over the range of their block.
+// The precision is resolved once per query, not per sample read.
+// Neurites only sample a thin region of the simulation space, so only a small
+// fraction of the blocks of a dense grid is ever allocated.
+class SparseBlockGrid {
+ public:
+  using Initializer = std::function<real_t(real_t, real_t, real_t)>;
+  static constexpr int kBlockSize = 8;
+
+  SparseBlockGrid(const std::string& name, const Initializer& initializer,
+                  real_t min_bound, real_t max_bound, real_t box_length,
+                  StoragePrecision precision = StoragePrecision::kReal)
+      : name_(name),
+        initializer_(initializer),
+        min_bound_(min_bound),
+        box_length_(box_length),
+        precision_(precision) {
+    boxes_ = std::max<int64_t>(
+        1, static_cast<int64_t>(std::ceil((max_bound - min_bound) /
+                                          box_length)));
+  }
+
+  const std::string& GetName() const { return name_; }
+
+  real_t GetConcentration(const Real3& position) const {
+    std::array<real_t, 4> sample;
+    Interpolate(position, true, &sample);
+    return sample[0];
+  }
+
+  // Same interface as DiffusionGrid::GetGradient.
+  void GetGradient(const Real3& position, Real3* gradient,
+                   bool normalize = true) const {
+    std::array<real_t, 4> sample;
+    Interpolate(position, true, &sample);
+    ToGradient(sample, gradient, normalize);
+  }
+
+  // GetGradient without materializing blocks. Returns false and leaves the
+  // gradient unchanged if a block around the position is not materialized.
+  bool FindGradient(const Real3& position, Real3* gradient,
+                    bool normalize = true) const {
+    std::array<real_t, 4> sample;
+    if (!Interpolate(position, false, &sample)) {
+      return false;
+    }
+    ToGradient(sample, gradient, normalize);
+    return true;
+  }
+
+  // GetConcentration without materializing blocks (see FindGradient).
+  bool FindConcentration(const Real3& position, real_t* concentration) const {
+    std::array<real_t, 4> sample;
+    if (!Interpolate(position, false, &sample)) {
+      return false;
+    }
+    *concentration = sample[0];
+    return true;
+  }
+
+  // Materializes the blocks queries at the position read and marks them as
+  // used in the given step (see Evict). Thread-safe.
+  void Materialize(const Real3& position, uint64_t step) const {
+    std::array<int64_t, 3> lower;
+    std::array<int64_t, 3> upper;
+    std::array<real_t, 3> weight;
+    Locate(position, &lower, &upper, &weight);
+    uint64_t block_key = ~uint64_t(0);
+    for (int corner = 0; corner < 8; corner++) {
+      std::array<int64_t, 3> box = {corner & 1 ? upper[0] : lower[0],
+                                    corner & 2 ? upper[1] : lower[1],
+                                    corner & 4 ? upper[2] : lower[2]};
+      auto key = BlockKey(box);
+      if (key != block_key) {
+        GetEntry(box)->used.store(step, std::memory_order_relaxed);
+        block_key = key;
+      }
+    }
+  }
+
+  // Frees the blocks that were last marked by Materialize more than max_age
+  // steps before the given step. Returns the number of freed blocks. Must not
+  // be called concurrently with queries.
+  size_t Evict(uint64_t step, uint64_t max_age) const {
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    size_t evicted = 0;
+    for (auto it = blocks_.begin(); it != blocks_.end();) {
+      if (step - it->second->used.load(std::memory_order_relaxed) > max_age) {
+        it = blocks_.erase(it);
+        evicted++;
+      } else {
+        ++it;
+      }
+    }
+    return evicted;
+  }
+
+  // Batched GetGradient (normalized) for the n positions (x[i], y[i], z[i]).
+  void GetGradients(size_t n, const real_t* x, const real_t* y,
+                    const real_t* z, real_t* gx, real_t* gy,
+                    real_t* gz) const {
+#pragma omp parallel for
+    for (size_t i = 0; i < n; i++) {
+      Real3 gradient;
+      GetGradient({x[i], y[i], z[i]}, &gradient);
+      gx[i] = gradient[0];
+      gy[i] = gradient[1];
+      gz[i] = gradient[2];
+    }
+  }
+
+ private:
+  static constexpr int kBoxesPerBlock = kBlockSize * kBlockSize * kBlockSize;
+  // concentration and x, y and z gradient at the center of every box of a
+  // block
+  template <typename TSample>
+  using Block = PackedArray<TSample, 4>;
+  struct Entry {
+    virtual ~Entry() {}
+    // last step in which Materialize marked the block
+    std::atomic<uint64_t> used{0};
+  };
+  // block of the sample type of the precision of the grid
+  template <typename TSample>
+  struct TypedEntry : public Entry {
+    Block<TSample> block;
+  };
+
+  std::string name_;
+  Initializer initializer_;
+  real_t min_bound_;
+  real_t box_length_;
+  StoragePrecision precision_;
+  // boxes per dimension
+  int64_t boxes_;
+  mutable std::shared_mutex mutex_;
+  mutable std::unordered_map<uint64_t, std::unique_ptr<Entry>> blocks_;
+
+  static void ToGradient(const std::array<real_t, 4>& sample, Real3* gradient,
+                         bool normalize) {
+    *gradient = {sample[1], sample[2], sample[3]};
+    if (normalize) {
+      real_t norm = gradient->Norm();
+      if (norm > 1e-10) {
+        *gradient /= norm;
+      }
+    }
+  }
+
+  // Interpolates concentration and gradient between the eight box centers
+  // around the position. Missing blocks are materialized if materialize is
+  // set; otherwise returns false if a block is missing.
+  bool Interpolate(const Real3& position, bool materialize,
+                   std::array<real_t, 4>* result) const {
+    return DispatchPrecision(precision_, [&](auto sample) {
+      return InterpolateAs<decltype(sample)>(position, materialize, result);
+    });
+  }
+
+  template <typename TSample>
+  bool InterpolateAs(const Real3& position, bool materialize,
+                     std::array<real_t, 4>* result) const {
+    std::array<int64_t, 3> lower;
+    std::array<int64_t, 3> upper;
+    std::array<real_t, 3> weight;
+    Locate(position, &lower, &upper, &weight);
+
+    *result = {0, 0, 0, 0};
+    const Block<TSample>* block = nullptr;
+    uint64_t block_key = ~uint64_t(0);
+    for (int corner = 0; corner < 8; corner++) {
+      std::array<int64_t, 3> box = {corner & 1 ? upper[0] : lower[0],
+                                    corner & 2 ? upper[1] : lower[1],
+                                    corner & 4 ? upper[2] : lower[2]};
+      // the corners mostly share a block
+      auto key = BlockKey(box);
+      if (key != block_key) {
+        const Entry* entry = materialize ? GetEntry(box) : FindEntry(box);
+        if (entry == nullptr) {
+          return false;
+        }
+        block = &static_cast<const TypedEntry<TSample>*>(entry)->block;
+        block_key = key;
+      }
+      real_t w = (corner & 1 ? weight[0] : 1 - weight[0]) *
+                 (corner & 2 ? weight[1] : 1 - weight[1]) *
+                 (corner & 4 ? weight[2] : 1 - weight[2]);
+      auto idx = BoxInBlock(box);
+      for (int i = 0; i < 4; i++) {
+        (*result)[i] += w * block->Get(idx, i);
+      }
+    }
+    return true;
+  }
+
+  // Computes the boxes whose centers enclose the position and the
+  // interpolation weights of the upper ones.
+  void Locate(const Real3& position, std::array<int64_t, 3>* lower,
+              std::array<int64_t, 3>* upper,
+              std::array<real_t, 3>* weight) const {
+    for (int d = 0; d < 3; d++) {
+      real_t t = (position[d] - min_bound_) / box_length_ - 0.5;
+      t = std::min(std::max(t, real_t(0)), static_cast<real_t>(boxes_ - 1));
+      (*lower)[d] = static_cast<int64_t>(t);
+      (*upper)[d] = std::min((*lower)[d] + 1, boxes_ - 1);
+      (*weight)[d] = t - (*lower)[d];
+    }
+  }
+
+  static uint64_t BlockKey(const std::array<int64_t, 3>& box) {
+    return (static_cast<uint64_t>(box[2] / kBlockSize) << 42) |
+           (static_cast<uint64_t>(box[1] / kBlockSize) << 21) |
+           static_cast<uint64_t>(box[0] / kBlockSize);
+  }
+
+  static size_t BoxInBlock(const std::array<int64_t, 3>& box) {
+    return ((box[2] % kBlockSize) * kBlockSize + box[1] % kBlockSize) *
+               kBlockSize +
+           box[0] % kBlockSize;
+  }
+
+  // Returns the block containing the box, or nullptr if it is not
+  // materialized. Thread-safe.
+  Entry* FindEntry(const std::array<int64_t, 3>& box) const {
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    auto it = blocks_.find(BlockKey(box));
+    return it != blocks_.end() ? it->second.get() : nullptr;
+  }
+
+  // Returns the block containing the box and materializes it if necessary.
+  // Thread-safe.
+  Entry* GetEntry(const std::array<int64_t, 3>& box) const {
+    if (auto* entry = FindEntry(box)) {
+      return entry;
+    }
+    auto key = BlockKey(box);
+    std::array<std::vector<real_t>, 4> samples;
+    for (auto& component : samples) {
+      component.resize(kBoxesPerBlock);
+    }
+    std::array<int64_t, 3> first;
+    for (int d = 0; d < 3; d++) {
+      first[d] = box[d] / kBlockSize * kBlockSize;
+    }
+    const real_t h = box_length_;
+    const auto& c = initializer_;
+    for (int z = 0; z < kBlockSize; z++) {
+      for (int y = 0; y < kBlockSize; y++) {
+        for (int x = 0; x < kBlockSize; x++) {
+          real_t px = min_bound_ + (first[0] + x + 0.5) * h;
+          real_t py = min_bound_ + (first[1] + y + 0.5) * h;
+          real_t pz = min_bound_ + (first[2] + z + 0.5) * h;
+          auto idx = (z * kBlockSize + y) * kBlockSize + x;
+          samples[0][idx] = c(px, py, pz);
+          samples[1][idx] = (c(px + h, py, pz) - c(px - h, py, pz)) / (2 * h);
+          samples[2][idx] = (c(px, py + h, pz) - c(px, py - h, pz)) / (2 * h);
+          samples[3][idx] = (c(px, py, pz + h) - c(px, py, pz - h)) / (2 * h);
+        }
+      }
+    }
+    std::unique_ptr<Entry> block(
+        DispatchPrecision(precision_, [&](auto sample) -> Entry* {
+          auto* typed = new TypedEntry<decltype(sample)>();
+          typed->block = Block<decltype(sample)>(samples);
+          return typed;
+        }));
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    // another thread may have materialized the block in the meantime
+    auto& entry = blocks_[key];
+    if (entry == nullptr) {
+      entry = std::move(block);
+    }
+    return entry.get();
+  }
+};
+
+// Static substance sampled on two levels of sparse block grids. The coarse
+// level covers every query; the fine level is only materialized around the
+// positions passed to Refine, e.g. the growing tips, and answers the queries
+// whose surrounding fine blocks exist. The resolution is therefore high where
+// neurites grow and low everywhere else. Fine blocks that tips left behind are
+// freed by Update, so the fine level follows the growth front.
+class MultiResolutionGrid {
+ public:
+  MultiResolutionGrid(const std::string& name,
+                      const SparseBlockGrid::Initializer& initializer,
+                      real_t min_bound, real_t max_bound,
+                      real_t coarse_box_length, real_t fine_box_length,
+                      StoragePrecision precision = StoragePrecision::kReal)
+      : name_(name),
+        coarse_(name, initializer, min_bound, max_bound, coarse_box_length,
+                precision),
+        fine_(name, initializer, min_bound, max_bound, fine_box_length,
+              precision),
+        deferred_(ThreadInfo::GetInstance()->GetMaxThreads()) {}
+
+  const std::string& GetName() const { return name_; }
+
+  // Refines the grid around the n positions (x[i], y[i], z[i]). Thread-safe.
+  void Refine(size_t n, const real_t* x, const real_t* y,
+              const real_t* z) const {
+    auto step = Simulation::GetActive()->GetScheduler()->GetSimulatedSteps();
+#pragma omp parallel for
+    for (size_t i = 0; i < n; i++) {
+      fine_.Materialize({x[i], y[i], z[i]}, step);
+    }
+  }
+
+  // Refines the grid around the position at the end of the step (see
+  // Update). Agent behaviors refine this way: if they refined immediately,
+  // whether another agent of the same step reads fine or coarse samples would
+  // depend on the order of the agents and on the threads. Thread-safe.
+  void DeferRefine(const Real3& position) const {
+    deferred_[ThreadInfo::GetInstance()->GetMyThreadId()].push_back(position);
+  }
+
+  // Refines the grid around the positions passed to DeferRefine in this step,
+  // then frees the fine blocks that were not refined in the last max_age
+  // steps (0 keeps them); the coarse level answers their queries again. Must
+  // not be called concurrently with queries.
+  void Update(uint64_t max_age) const {
+    auto step = Simulation::GetActive()->GetScheduler()->GetSimulatedSteps();
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t t = 0; t < deferred_.size(); t++) {
+      for (const auto& position : deferred_[t]) {
+        fine_.Materialize(position, step);
+      }
+      deferred_[t].clear();
+    }
+    if (max_age != 0) {
+      fine_.Evict(step, max_age);
+    }
+  }
+
+  real_t GetConcentration(const Real3& position) const {
+    real_t concentration;
+    if (fine_.FindConcentration(position, &concentration)) {
+      return concentration;
+    }
+    return coarse_.GetConcentration(position);
+  }
+
+  // Same interface as DiffusionGrid::GetGradient.
+  void GetGradient(const Real3& position, Real3* gradient,
+                   bool normalize = true) const {
+    if (!fine_.FindGradient(position, gradient, normalize)) {
+      coarse_.GetGradient(position, gradient, normalize);
+    }
+  }
+
+  // Batched GetGradient (normalized) for the n positions (x[i], y[i], z[i]).
+  void GetGradients(size_t n, const real_t* x, const real_t* y,
+                    const real_t* z, real_t* gx, real_t* gy,
+                    real_t* gz) const {
+#pragma omp parallel for
+    for (size_t i = 0; i < n; i++) {
+      Real3 gradient;
+      GetGradient({x[i], y[i], z[i]}, &gradient);
+      gx[i] = gradient[0];
+      gy[i] = gradient[1];
+      gz[i] = gradient[2];
+    }
+  }
+
+ private:
+  std::string name_;
+  SparseBlockGrid coarse_;
+  SparseBlockGrid fine_;
+  // positions passed to DeferRefine, per thread
+  mutable std::vector<std::vector<Real3>> deferred_;
+};
+
+}  // namespace bdm
+
+#endif  // SPARSE_GRID_H_
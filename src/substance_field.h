@@ -0,0 +1,220 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SUBSTANCE_FIELD_H_
+#define SUBSTANCE_FIELD_H_
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "biodynamo.h"
+#include "gradient_grid.h"
+#include "sim_param.h"
+#include "sparse_grid.h"
+#include "substance_sources.h"
+
+namespace bdm {
+
+// Static substance with a Gaussian concentration profile along one axis (the
+// profile of GaussianBand). Concentration and gradient are evaluated in closed
+// form, so the substance needs neither a diffusion grid nor diffusion steps.
+class AnalyticGaussianBand {
+ public:
+  AnalyticGaussianBand(const std::string& name, const GaussianBand& band)
+      : name_(name),
+        mean_(band.mean_),
+        sigma_(band.sigma_),
+        axis_(band.axis_) {}
+
+  const std::string& GetName() const { return name_; }
+
+  real_t GetConcentration(const Real3& position) const {
+    real_t x = (position[axis_] - mean_) / sigma_;
+    return std::exp(-0.5 * x * x) / (sigma_ * std::sqrt(2 * Math::kPi));
+  }
+
+  // Same interface as DiffusionGrid::GetGradient. The normalized gradient
+  // points along the axis towards the mean.
+  void GetGradient(const Real3& position, Real3* gradient,
+                   bool normalize = true) const {
+    real_t delta = mean_ - position[axis_];
+    *gradient = {0, 0, 0};
+    if (normalize) {
+      (*gradient)[axis_] = delta > 0 ? 1 : (delta < 0 ? -1 : 0);
+    } else {
+      (*gradient)[axis_] =
+          delta / (sigma_ * sigma_) * GetConcentration(position);
+    }
+  }
+
+  // Batched GetGradient (normalized) for the n positions (x[i], y[i], z[i]).
+  void GetGradients(size_t n, const real_t* x, const real_t* y,
+                    const real_t* z, real_t* gx, real_t* gy,
+                    real_t* gz) const {
+    const real_t* coordinate = axis_ == 0 ? x : (axis_ == 1 ? y : z);
+    real_t* along = axis_ == 0 ? gx : (axis_ == 1 ? gy : gz);
+    const real_t mean = mean_;
+    for (auto* g : {gx, gy, gz}) {
+      std::fill(g, g + n, 0);
+    }
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+      real_t delta = mean - coordinate[i];
+      along[i] = delta > 0 ? 1 : (delta < 0 ? -1 : 0);
+    }
+  }
+
+ private:
+  std::string name_;
+  real_t mean_;
+  real_t sigma_;
+  uint8_t axis_;
+};
+
+// Registry of the substances represented by fields of type TField instead of
+// diffusion grids.
+template <typename TField>
+class SubstanceRegistry {
+ public:
+  static SubstanceRegistry* Get() {
+    static SubstanceRegistry kRegistry;
+    return &kRegistry;
+  }
+
+  // Defines a substance and takes ownership of its field. Not thread-safe;
+  // call it during initialization.
+  void Define(int substance, TField* field) { fields_[substance].reset(field); }
+
+  // Returns the field of the substance, or nullptr if it has none.
+  const TField* Find(int substance) const {
+    auto it = fields_.find(substance);
+    return it != fields_.end() ? it->second.get() : nullptr;
+  }
+
+  // Calls f(const TField*) for every defined field.
+  template <typename TFunction>
+  void ForEach(TFunction f) const {
+    for (const auto& entry : fields_) {
+      f(entry.second.get());
+    }
+  }
+
+ private:
+  std::unordered_map<int, std::unique_ptr<TField>> fields_;
+
+  SubstanceRegistry() {}
+};
+
+using AnalyticSubstances = SubstanceRegistry<AnalyticGaussianBand>;
+using SparseSubstances = SubstanceRegistry<SparseBlockGrid>;
+using MultiResolutionSubstances = SubstanceRegistry<MultiResolutionGrid>;
+
+// Handle of the substance a growth rule follows: its analytic field, sparse
+// grid or multi-resolution grid if the substance was defined as one, its
+// diffusion grid otherwise. The gradient of a diffusion grid is read from a
+// precomputed GradientGrid if SimParam declares the grids static and the
+// substance has no source.
+class SubstanceField {
+ public:
+  SubstanceField() {}
+  explicit SubstanceField(int substance)
+      : analytic_(AnalyticSubstances::Get()->Find(substance)) {
+    sparse_ = SparseSubstances::Get()->Find(substance);
+    multires_ = MultiResolutionSubstances::Get()->Find(substance);
+    if (analytic_ != nullptr || sparse_ != nullptr || multires_ != nullptr) {
+      return;
+    }
+    auto* sim = Simulation::GetActive();
+    grid_ = sim->GetResourceManager()->GetDiffusionGrid(substance);
+    if (grid_ != nullptr &&
+        sim->GetParam()->Get<SimParam>()->precompute_gradients &&
+        !SubstanceSources::Get()->HasSource(substance)) {
+      gradient_grid_ = GradientGrids::Get()->Find(substance, grid_);
+    }
+  }
+
+  // Returns whether the substance is defined.
+  bool IsDefined() const {
+    return analytic_ != nullptr || sparse_ != nullptr ||
+           multires_ != nullptr || grid_ != nullptr;
+  }
+
+  // Refines a multi-resolution grid around the n positions (x[i], y[i],
+  // z[i]) of growing tips. Other representations have a fixed resolution.
+  void Refine(size_t n, const real_t* x, const real_t* y,
+              const real_t* z) const {
+    if (multires_ != nullptr) {
+      multires_->Refine(n, x, y, z);
+    }
+  }
+
+  // Refines a multi-resolution grid around the position of a single tip at
+  // the end of the step (see MultiResolutionGrid::DeferRefine).
+  void DeferRefine(const Real3& position) const {
+    if (multires_ != nullptr) {
+      multires_->DeferRefine(position);
+    }
+  }
+
+  void GetGradient(const Real3& position, Real3* gradient) const {
+    if (analytic_ != nullptr) {
+      analytic_->GetGradient(position, gradient);
+    } else if (sparse_ != nullptr) {
+      sparse_->GetGradient(position, gradient);
+    } else if (multires_ != nullptr) {
+      multires_->GetGradient(position, gradient);
+    } else if (gradient_grid_ != nullptr) {
+      gradient_grid_->GetGradient(position, gradient);
+    } else {
+      grid_->GetGradient(position, gradient);
+    }
+  }
+
+  // Batched GetGradient for the n positions (x[i], y[i], z[i]); writes the
+  // gradients to gx, gy and gz. One call answers the queries of all tips.
+  void GetGradients(size_t n, const real_t* x, const real_t* y,
+                    const real_t* z, real_t* gx, real_t* gy,
+                    real_t* gz) const {
+    if (analytic_ != nullptr) {
+      analytic_->GetGradients(n, x, y, z, gx, gy, gz);
+    } else if (sparse_ != nullptr) {
+      sparse_->GetGradients(n, x, y, z, gx, gy, gz);
+    } else if (multires_ != nullptr) {
+      multires_->GetGradients(n, x, y, z, gx, gy, gz);
+    } else if (gradient_grid_ != nullptr) {
+      gradient_grid_->GetGradients(n, x, y, z, gx, gy, gz);
+    } else {
+#pragma omp parallel for
+      for (size_t i = 0; i < n; i++) {
+        Real3 gradient;
+        grid_->GetGradient({x[i], y[i], z[i]}, &gradient);
+        gx[i] = gradient[0];
+        gy[i] = gradient[1];
+        gz[i] = gradient[2];
+      }
+    }
+  }
+
+ private:
+  const AnalyticGaussianBand* analytic_ = nullptr;
+  const SparseBlockGrid* sparse_ = nullptr;
+  const MultiResolutionGrid* multires_ = nullptr;
+  DiffusionGrid* grid_ = nullptr;
+  const GradientGrid* gradient_grid_ = nullptr;
+};
+
+}  // namespace bdm
+
+#endif  // SUBSTANCE_FIELD_H_
@@ -0,0 +1,54 @@
+// -----------------------------------------------------------------------------
+//
+// Copyright (C) 2021 CERN & University of Surrey for the benefit of the
+// BioDynaMo collaboration. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+//
+// See the LICENSE file distributed with this work for details.
+// See the NOTICE file distributed with this work for additional information
+// regarding copyright ownership.
+//
+// -----------------------------------------------------------------------------
+#ifndef SUBSTANCE_SOURCES_H_
+#define SUBSTANCE_SOURCES_H_
+
+#include <mutex>
+#include <unordered_set>
+#include "biodynamo.h"
+
+namespace bdm {
+
+// Substances that agents change, e.g. by secretion. Anything that adds or
+// removes a substance registers it here before the simulation starts, so its
+// diffusion is not skipped (see constant_substance_op) and its gradient is not
+// precomputed (see SubstanceField).
+class SubstanceSources {
+ public:
+  static SubstanceSources* Get() {
+    static SubstanceSources kSources;
+    return &kSources;
+  }
+
+  // Registers a source of the substance. Thread-safe.
+  void Add(int substance) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    sources_.insert(substance);
+  }
+
+  bool HasSource(int substance) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return sources_.count(substance) != 0;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_set<int> sources_;
+
+  SubstanceSources() {}
+};
+
+}  // namespace bdm
+
+#endif  // SUBSTANCE_SOURCES_H_
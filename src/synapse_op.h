@@ -14,169 +14,99 @@
 #ifndef SYNAPSE_OP_H
 #define SYNAPSE_OP_H
 
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "basic_neuron.h"
 #include "biodynamo.h"
 #include "neuroscience/neuroscience.h"
+#include "sim_param.h"
 
 namespace bdm {
 
-// Synapse behaviour
-struct SynapseFormation : public Behavior {
-  BDM_BEHAVIOR_HEADER(SynapseFormation, Behavior, 1);
-
-  // This function is used to detect dendritic agents in the simulation.
-  // It takes an agent and a pointer to a direction vector as arguments.
-  // The function first identifies the mother neuron of the given agent.
-  // Then, it iterates over all neighboring agents within a certain distance.
-  // If a neighboring agent belongs to a different neuron, it updates the
-  // closest neighbor information. Finally, it returns the unique identifier
-  // (UID) of the closest neighbor agent.
-  AgentUid DendriticDetector(Agent* agent, Real3* neighbours_direction) {
-    // Cast the agent to a neurite element
-    auto* neurite = bdm_static_cast<NeuriteElement*>(agent);
-    // Get the active simulation and its execution context
-    auto* sim = Simulation::GetActive();
-    auto* ctxt = sim->GetExecutionContext();
-
-    // Find the mother neuron of the neurite
-    auto* mother = dynamic_cast<NeuriteElement*>(neurite)->GetMother().Get();
-    basic_neuron* mother_neuron = dynamic_cast<basic_neuron*>(mother);
-    while (mother_neuron == nullptr && mother != nullptr) {
-      mother = dynamic_cast<NeuriteElement*>(mother)->GetMother().Get();
-      mother_neuron = dynamic_cast<basic_neuron*>(mother);
+// Returns the element of another neuron that is closest to the neurite and
+// within contact distance (1), or nullptr if there is none. Only reads the
+// simulation, so it may run for different neurites in parallel. The neighbors
+// are queried from the environment: the execution context may answer from
+// the neighbor cache of the agent it executed last, which is not the neurite.
+inline NeuriteElement* FindSynapsePartner(NeuriteElement* neurite) {
+  auto* env = Simulation::GetActive()->GetEnvironment();
+  auto* neuron = FindParentNeuron(neurite);
+
+  NeuriteElement* partner = nullptr;
+  real_t closest_squared_distance = std::numeric_limits<real_t>::max();
+  auto find_partner = L2F([&](Agent* agent, real_t squared_distance) {
+    auto* neighbor = dynamic_cast<NeuriteElement*>(agent);
+    if (neighbor == nullptr || squared_distance >= closest_squared_distance) {
+      return;
     }
-
-    // Get the UID of the mother neuron
-    int mother_cell_uid;
-    if (mother_neuron != nullptr) {
-      mother_cell_uid = mother_neuron->GetUid();
+    if (FindParentNeuron(neighbor) != neuron) {
+      partner = neighbor;
+      closest_squared_distance = squared_distance;
     }
+  });
+  env->ForEachNeighbor(find_partner, *neurite, 1);
+  return partner;
+}
 
-    // Initialize closest neighbor information
-    int closest_neighbour_uid = -1;
-    real_t closest_distance = std::numeric_limits<real_t>::max();
-
-    // Define a lambda function to process each neighbor
-    auto print_id_distance = L2F([&](Agent* a, real_t squared_distance) {
-      // If the neighbor is a neurite element
-      if (auto* neighbor_den = dynamic_cast<NeuriteElement*>(a)) {
-        // Get the mother neuron of the neighbor
-        auto* neighbor_mother =
-            dynamic_cast<NeuriteElement*>(neighbor_den)->GetMother().Get();
-
-        basic_neuron* neighbor_mother_neuron =
-            dynamic_cast<basic_neuron*>(neighbor_mother);
+// This operation forms the synapses of the simulation. It is only scheduled in
+// the detection phase (see Simulate), where from step synapse_start_step on,
+// every synapse_frequency steps, each neurite element connects its neuron to
+// the neuron of the closest element of another neuron in contact with it. A
+// negative start step counts from the end of the simulation, so -1 is its last
+// step, also if growth converged early (see SetEndStep).
+// The partners of all elements are searched in parallel; the synapses are then
+// created serially, since they modify the somata of both neurons.
+struct synapse_op : public StandaloneOperationImpl {
+  BDM_OP_HEADER(synapse_op);
 
-        // If the mother is not a neuron, keep going up the tree
-        while (neighbor_mother_neuron == nullptr &&
-               neighbor_mother != nullptr) {
-          neighbor_mother =
-              dynamic_cast<NeuriteElement*>(neighbor_mother)->GetMother().Get();
-          neighbor_mother_neuron = dynamic_cast<basic_neuron*>(neighbor_mother);
-        }
+  void operator()() override {
+    auto* sim = Simulation::GetActive();
+    auto* sparam = sim->GetParam()->Get<SimParam>();
+    if (sparam->synapse_frequency == 0) {
+      Log::Fatal("synapse_op", "synapse_frequency must be at least 1");
+    }
+    int64_t step = sim->GetScheduler()->GetSimulatedSteps();
+    int64_t start = sparam->synapse_start_step;
+    if (start < 0) {
+      start += end_step_ != 0 ? end_step_ : sparam->simulation_steps;
+    }
+    if (step < start || (step - start) % sparam->synapse_frequency != 0) {
+      return;
+    }
 
-        // Get the UID of the neighbor's mother neuron
-        int neighbor_mother_cell_uid = neighbor_mother_neuron->GetUid();
-        // If the neighbor belongs to a different neuron
-        if (neighbor_mother_cell_uid != mother_cell_uid) {
-          // Update the closest neighbor information if the neighbor is closer
-          real_t distance = std::sqrt(squared_distance);
-          if (distance < closest_distance && distance < 1) {
-            closest_neighbour_uid = neighbor_den->GetUid().GetIndex();
-            closest_distance = distance;
-          }
-        }
+    // the lengths of the elements changed since their path distances were
+    // derived
+    UpdatePathDistances();
+    auto* rm = sim->GetResourceManager();
+    neurites_.clear();
+    rm->ForEachAgent([&](Agent* agent) {
+      if (auto* neurite = dynamic_cast<NeuriteElement*>(agent)) {
+        neurites_.push_back(neurite);
       }
     });
-    // Process all neighbors within a certain distance
-    ctxt->ForEachNeighbor(print_id_distance, *neurite,
-                          25);  // 25 is the squared distance threshold
-
-    // Return the UID of the closest neighbor
-    return int(closest_neighbour_uid) != -1 ? AgentUid(closest_neighbour_uid)
-                                            : AgentUid(-1);
-  };
-
-  // This function is executed for each agent in the simulation.
-  void Run(Agent* agent) override {
-    // Get the active simulation's resource manager
-    auto* rm = Simulation::GetActive()->GetResourceManager();
-    // Get the current simulation time step
-    int time_step =
-        Simulation::GetActive()->GetScheduler()->GetSimulatedSteps();
-
-    // Cast the agent to a neurite element
-    auto* neurite = bdm_static_cast<NeuriteElement*>(agent);
-
-    // If the neurite has not formed a synapse yet
-    if (!synapsed_) {
-      // Initialize a direction vector for the closest neighbor
-      Real3 neighbours_direction;
-      // Detect the closest dendritic neighbor
-      AgentUid closest_neighbour_uid =
-          DendriticDetector(agent, &neighbours_direction);
-
-      // If a closest neighbor was found
-      if (closest_neighbour_uid != AgentUid(-1)) {
-        // Create a synapse between the neurite and the closest neighbor
-        CreateSynapseBetweenNeurites(
-            neurite,
-            // Get the closest neighbor agent from the resource manager and cast
-            // it to a neurite element
-            dynamic_cast<NeuriteElement*>(rm->GetAgent(closest_neighbour_uid)),
-            0.0,       // The synapse strength
-            1,         // The synapse type
-            time_step  // The current simulation time step
-        );
+    partners_.resize(neurites_.size());
+#pragma omp parallel for
+    for (size_t i = 0; i < neurites_.size(); i++) {
+      partners_[i] = FindSynapsePartner(neurites_[i]);
+    }
+    for (size_t i = 0; i < neurites_.size(); i++) {
+      if (partners_[i] != nullptr) {
+        CreateSynapseBetweenNeurites(neurites_[i], partners_[i], 0.0, 1,
+                                     static_cast<int>(step));
       }
     }
   }
 
-  // A flag indicating whether the neurite has checked for a synapse
-  bool synapsed_ = false;
-};
-// This function adds a SynapseFormation behavior to the given axon element.
-// It first checks if the axon element is a neurite element.
-// If it is, it adds a new SynapseFormation behavior to it.
-inline void AddSynapseBehavior(Agent* axon_element) {
-  // Cast the agent to a neurite element
-  auto axon = dynamic_cast<NeuriteElement*>(axon_element);
-
-  // Check if axon is nullptr before accessing its methods
-  if (axon == nullptr) {
-    return;
-  }
-
-  // Add a new SynapseFormation behavior to the neurite element
-  axon->AddBehavior(new SynapseFormation());
-}
-
-// This struct represents a standalone operation in the simulation.
-// It overrides the operator() method to add a SynapseFormation behavior
-// to each agent in the simulation at a certain time step.
-struct synapse_op : public StandaloneOperationImpl {
-  // Macro to set the operation header
-  BDM_OP_HEADER(synapse_op);
+  // Sets the step at which the simulation ends, from which negative start
+  // steps count, if it ends before simulation_steps.
+  void SetEndStep(uint64_t end_step) { end_step_ = end_step; }
 
-  // Override the operator() method
-  void operator()() override {
-    // Get the active simulation's resource manager
-    auto* rm = Simulation::GetActive()->GetResourceManager();
-
-    // call the function when simulation time is -3 the maximum value of the
-    // simulation time. This is to ensure the operation is registered and runs
-    // for the last time step.
-    if (Simulation::GetActive()->GetScheduler()->GetSimulatedSteps() >
-        500 - 3) {
-      // For each agent in the simulation
-      rm->ForEachAgent([&](Agent* agent) {
-        // If the agent is not nullptr
-        if (agent != nullptr) {
-          // Add a SynapseFormation behavior to the agent
-          AddSynapseBehavior(agent);
-        }
-      });
-    }
-  }
+ private:
+  uint64_t end_step_ = 0;
+  // reused between phases
+  std::vector<NeuriteElement*> neurites_;
+  std::vector<NeuriteElement*> partners_;
 };
 
 }  // namespace bdm
@@ -12,11 +12,36 @@
 //
 // -----------------------------------------------------------------------------
 #include "synapses.h"
+#include "allocation_report_op.h"
 #include "basic_neuron.h"
+#include "behavior_parking_op.h"
+#include "constant_substance_op.h"
+#include "dendrite_growth_op.h"
+#include "gradient_benchmark_op.h"
+#include "growth_benchmark_op.h"
+#include "morphology_export_op.h"
+#include "multires_update_op.h"
+#include "neurite_coarsening_op.h"
+#include "neurite_freezing_op.h"
+#include "secretion_op.h"
+#include "sim_param.h"
 #include "synapse_op.h"
 
 namespace bdm {
+const ParamGroupUid SimParam::kUid = ParamGroupUidGenerator::Get()->NewUid();
+
 BDM_REGISTER_OP(synapse_op, "synapse_op", kCpu);
+BDM_REGISTER_OP(dendrite_growth_op, "dendrite_growth", kCpu);
+BDM_REGISTER_OP(neurite_coarsening_op, "neurite_coarsening", kCpu);
+BDM_REGISTER_OP(neurite_freezing_op, "neurite_freezing", kCpu);
+BDM_REGISTER_OP(gradient_benchmark_op, "gradient_benchmark", kCpu);
+BDM_REGISTER_OP(secretion_op, "secretion", kCpu);
+BDM_REGISTER_OP(constant_substance_op, "constant_substances", kCpu);
+BDM_REGISTER_OP(morphology_export_op, "morphology_export", kCpu);
+BDM_REGISTER_OP(growth_benchmark_op, "growth_benchmark", kCpu);
+BDM_REGISTER_OP(allocation_report_op, "allocation_report", kCpu);
+BDM_REGISTER_OP(multires_update_op, "multires_update", kCpu);
+BDM_REGISTER_OP(behavior_parking_op, "behavior_parking", kCpu);
 }  // namespace bdm
 
 int main(int argc, const char** argv) { return bdm::Simulate(argc, argv); }
\ No newline at end of file
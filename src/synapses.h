@@ -14,177 +14,287 @@
 #ifndef SYNAPSES_H_
 #define SYNAPSES_H_
 
-#include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
+#include "basic_neurite.h"
 #include "basic_neuron.h"
 #include "biodynamo.h"
+#include "constant_substance_op.h"
+#include "dendrite_growth_op.h"
+#include "growth_behavior.h"
+#include "growth_convergence.h"
+#include "growth_rule.h"
+#include "morphology_export_op.h"
 #include "neuroscience/neuroscience.h"
+#include "population.h"
+#include "secretion.h"
+#include "sim_param.h"
+#include "simulation_phase.h"
+#include "substance_field.h"
+#include "synapse_op.h"
 
 namespace bdm {
 
-enum Substances { kApical, kBasal };
-
-struct ApicalDendriteGrowth : public Behavior {
-  BDM_BEHAVIOR_HEADER(ApicalDendriteGrowth, Behavior, 1);
-  ApicalDendriteGrowth() { AlwaysCopyToNew(); }
-  virtual ~ApicalDendriteGrowth() {}
-
-  void Initialize(const NewAgentEvent& event) override {
-    Base::Initialize(event);
-    can_branch_ = false;
-  }
-
-  void Run(Agent* agent) override {
-    auto* sim = Simulation::GetActive();
-    auto* random = sim->GetRandom();
-    auto* rm = sim->GetResourceManager();
-
-    if (!init_) {
-      dg_guide_ = rm->GetDiffusionGrid(kApical);
-      init_ = true;
+// Extends the initial neurites of the cell type from the soma. Only modifies
+// the soma and its new neurites, so it may run for different somata in
+// parallel.
+inline void ExtendInitialNeurites(basic_neuron* soma, const CellType& type) {
+  auto* sparam = Simulation::GetActive()->GetParam()->Get<SimParam>();
+
+  // neurites are created as BasicNeurite to track path distance and branch
+  // order while they grow
+  BasicNeurite prototype;
+  std::vector<NeuriteElement*> dendrites;
+  for (const auto& neurite : type.neurites) {
+    if (neurite.direction.size() != 3) {
+      Log::Fatal("ExtendInitialNeurites",
+                 "Initial neurite directions need three coordinates");
     }
-
-    auto* dendrite = bdm_static_cast<NeuriteElement*>(agent);
-    if (dendrite->GetDiameter() > 0.575) {
-      Real3 gradient;
-      dg_guide_->GetGradient(dendrite->GetPosition(), &gradient);
-
-      real_t gradient_weight = 0.06;
-      real_t randomness_weight = 0.3;
-      real_t old_direction_weight = 4;
-
-      auto random_axis = random->template UniformArray<3>(-1, 1);
-      auto old_direction = dendrite->GetSpringAxis() * old_direction_weight;
-      auto grad_direction = gradient * gradient_weight;
-      auto random_direction = random_axis * randomness_weight;
-
-      Real3 new_step_direction =
-          old_direction + random_direction + grad_direction;
-
-      dendrite->ElongateTerminalEnd(100, new_step_direction);
-      dendrite->SetDiameter(dendrite->GetDiameter() - 0.00071);
-
-      if (can_branch_ && dendrite->IsTerminal() &&
-          dendrite->GetDiameter() > 0.55 && random->Uniform() < 0.038) {
-        auto rand_noise = random->template UniformArray<3>(-0.1, 0.1);
-        Real3 branch_direction =
-            Math::Perp3(dendrite->GetUnitaryAxisDirectionVector() + rand_noise,
-                        random->Uniform(0, 1)) +
-            dendrite->GetSpringAxis();
-        auto* dendrite_2 = dendrite->Branch(branch_direction);
-        dendrite_2->SetDiameter(0.65);
-      }
+    if (neurite.rule <= kNoGrowth ||
+        static_cast<size_t>(neurite.rule) > sparam->growth_rules.size()) {
+      Log::Fatal("ExtendInitialNeurites", "Undefined growth rule ",
+                 neurite.rule);
     }
+    const auto& d = neurite.direction;
+    dendrites.push_back(soma->ExtendNewNeurite({d[0], d[1], d[2]}, &prototype));
   }
 
- private:
-  bool init_ = false;
-  bool can_branch_ = true;
-  DiffusionGrid* dg_guide_ = nullptr;
-};
-
-struct BasalDendriteGrowth : public Behavior {
-  BDM_BEHAVIOR_HEADER(BasalDendriteGrowth, Behavior, 1);
-  BasalDendriteGrowth() { AlwaysCopyToNew(); }
-  virtual ~BasalDendriteGrowth() {}
-
-  void Run(Agent* agent) override {
-    auto* sim = Simulation::GetActive();
-    auto* random = sim->GetRandom();
-    auto* rm = sim->GetResourceManager();
-
-    if (!init_) {
-      dg_guide_ = rm->GetDiffusionGrid(kBasal);
-      init_ = true;
+  if (sparam->secretion_rate > 0) {
+    for (auto* dendrite : dendrites) {
+      dendrite->AddBehavior(
+          new TipSecretion(kAttractant, sparam->secretion_rate));
     }
+  }
 
-    auto* dendrite = bdm_static_cast<NeuriteElement*>(agent);
-    if (dendrite->IsTerminal() && dendrite->GetDiameter() > 0.75) {
-      Real3 gradient;
-      dg_guide_->GetGradient(dendrite->GetPosition(), &gradient);
-
-      real_t gradient_weight = 0.03;
-      real_t randomness_weight = 0.4;
-      real_t old_direction_weight = 6;
-
-      auto random_axis = random->template UniformArray<3>(-1, 1);
-      auto old_direction = dendrite->GetSpringAxis() * old_direction_weight;
-      auto grad_direction = gradient * gradient_weight;
-      auto random_direction = random_axis * randomness_weight;
-
-      Real3 new_step_direction =
-          old_direction + random_direction + grad_direction;
-
-      dendrite->ElongateTerminalEnd(50, new_step_direction);
-      dendrite->SetDiameter(dendrite->GetDiameter() - 0.00085);
-
-      if (random->Uniform() < 0.006) {
-        dendrite->Bifurcate();
-      }
+  for (size_t i = 0; i < dendrites.size(); i++) {
+    auto rule = type.neurites[i].rule;
+    if (sparam->batched_growth) {
+      // grown by dendrite_growth_op
+      bdm_static_cast<BasicNeurite*>(dendrites[i])->SetGrowthRule(rule);
+    } else if (rule == kApicalGrowth) {
+      dendrites[i]->AddBehavior(new ApicalDendriteGrowth());
+    } else if (rule == kBasalGrowth) {
+      dendrites[i]->AddBehavior(new BasalDendriteGrowth());
+    } else {
+      // growth behaviors are only compiled for the policies
+      Log::Fatal("ExtendInitialNeurites", "Growth rule ", rule,
+                 " needs batched_growth");
     }
   }
+}
 
- private:
-  bool init_ = false;
-  DiffusionGrid* dg_guide_ = nullptr;
-};
-
-inline void AddInitialNeuron(const Real3& position) {
+inline void AddInitialNeuron(const Real3& position, const CellType& type) {
   auto* soma = new basic_neuron(position);
   soma->SetDiameter(10);
   Simulation::GetActive()->GetExecutionContext()->AddAgent(soma);
+  ExtendInitialNeurites(soma, type);
+}
 
-  auto* apical_dendrite = soma->ExtendNewNeurite({0, 0, 1});
-  auto* basal_dendrite1 = soma->ExtendNewNeurite({0, 0, -1});
-  auto* basal_dendrite2 = soma->ExtendNewNeurite({0, 0.6, -0.8});
-  auto* basal_dendrite3 = soma->ExtendNewNeurite({0.3, -0.6, -0.8});
-
-  apical_dendrite->AddBehavior(new ApicalDendriteGrowth());
-  basal_dendrite1->AddBehavior(new BasalDendriteGrowth());
-  basal_dendrite2->AddBehavior(new BasalDendriteGrowth());
-  basal_dendrite3->AddBehavior(new BasalDendriteGrowth());
+// Adds a neuron at each of the given positions; neuron i is of the cell type
+// SimParam::population_cell_types assigns to it. The somata are created
+// serially, so their uids, from which the random streams of their neurites
+// are derived, do not depend on the number of threads. The neurites, which
+// make up most of the work, are extended in parallel; every thread adds its
+// agents to its own execution context, and all of them are committed together
+// at the beginning of the simulation.
+inline void AddNeuronPopulation(const std::vector<Real3>& positions) {
+  auto* sim = Simulation::GetActive();
+  auto* sparam = sim->GetParam()->Get<SimParam>();
+  auto* ctxt = sim->GetExecutionContext();
+  std::vector<basic_neuron*> somata(positions.size());
+  std::vector<const CellType*> types(positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    somata[i] = new basic_neuron(positions[i]);
+    somata[i]->SetDiameter(10);
+    ctxt->AddAgent(somata[i]);
+    types[i] = &GetCellType(sparam, i);
+  }
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < somata.size(); i++) {
+    ExtendInitialNeurites(somata[i], *types[i]);
+  }
 }
 
 /// Create and initialize substances for neurite attraction
 inline void CreateExtracellularSubstances(const Param* p) {
-  using MI = ModelInitializer;
-  MI::DefineSubstance(kApical, "substance_apical", 0, 0, p->max_bound / 80);
-  MI::DefineSubstance(kBasal, "substance_basal", 0, 0, p->max_bound / 80);
   // initialize substance with gaussian distribution
   auto a_initializer = GaussianBand(p->max_bound, 200, Axis::kZAxis);
   auto b_initializer = GaussianBand(p->min_bound, 200, Axis::kZAxis);
+  // the substances neither diffuse nor decay, so they can be evaluated in
+  // closed form or sampled where needed instead of on a diffusion grid
+  const auto* sparam = p->Get<SimParam>();
+  using MI = ModelInitializer;
+  if (sparam->secretion_rate > 0) {
+    MI::DefineSubstance(kAttractant, "substance_attractant",
+                        sparam->attractant_diffusion, sparam->attractant_decay,
+                        p->max_bound / 80);
+  }
+  const auto& representation = sparam->substance_representation;
+  if (representation == "analytic") {
+    auto* substances = AnalyticSubstances::Get();
+    substances->Define(kApical, new AnalyticGaussianBand("substance_apical",
+                                                         a_initializer));
+    substances->Define(kBasal, new AnalyticGaussianBand("substance_basal",
+                                                        b_initializer));
+    return;
+  } else if (representation == "sparse") {
+    auto* substances = SparseSubstances::Get();
+    auto box_length = sparam->sparse_box_length;
+    substances->Define(
+        kApical, new SparseBlockGrid("substance_apical", a_initializer,
+                                     p->min_bound, p->max_bound, box_length,
+                                     GetStoragePrecision(kApical)));
+    substances->Define(
+        kBasal, new SparseBlockGrid("substance_basal", b_initializer,
+                                    p->min_bound, p->max_bound, box_length,
+                                    GetStoragePrecision(kBasal)));
+    return;
+  } else if (representation == "multires") {
+    auto* substances = MultiResolutionSubstances::Get();
+    auto coarse = sparam->multires_coarse_box_length;
+    auto fine = sparam->multires_fine_box_length;
+    substances->Define(kApical, new MultiResolutionGrid(
+                                    "substance_apical", a_initializer,
+                                    p->min_bound, p->max_bound, coarse, fine,
+                                    GetStoragePrecision(kApical)));
+    substances->Define(kBasal, new MultiResolutionGrid(
+                                   "substance_basal", b_initializer,
+                                   p->min_bound, p->max_bound, coarse, fine,
+                                   GetStoragePrecision(kBasal)));
+    return;
+  } else if (representation != "dense") {
+    Log::Fatal("CreateExtracellularSubstances",
+               "Unknown substance representation '", representation, "'");
+  }
+  MI::DefineSubstance(kApical, "substance_apical", 0, 0, p->max_bound / 80);
+  MI::DefineSubstance(kBasal, "substance_basal", 0, 0, p->max_bound / 80);
   MI::InitializeSubstance(kApical, a_initializer);
   MI::InitializeSubstance(kBasal, b_initializer);
 }
 
-/// Saves the morphology of the neuron in the SWC file format.
-inline void SaveNeuronMorphology(Simulation& sim) {
-  auto* rm = sim.GetResourceManager();
-  rm->ForEachAgent([&](Agent* agent) {
-    auto* soma = dynamic_cast<neuroscience::NeuronSoma*>(agent);
-    if (soma != nullptr) {
-      std::ofstream myfile;
-      myfile.open(sim.GetOutputDir() + "/neuron.swc");
-      soma->PrintSWC(myfile);
-    }
-  });
+// Writes the pending growth of the batched growth operation back to the
+// elements and reports the diffusion steps skipped during growth. Either
+// operation may be nullptr if it was not scheduled.
+inline void FinishGrowth(Operation* growth_op, Operation* constant_op) {
+  if (growth_op != nullptr) {
+    growth_op->GetImplementation<dendrite_growth_op>()->Flush();
+  }
+  if (constant_op != nullptr) {
+    auto* skip = constant_op->GetImplementation<constant_substance_op>();
+    std::cout << "Skipped " << skip->GetSkippedSteps()
+              << " diffusion steps of constant substances (about "
+              << skip->GetSkippedTime() << " s)" << std::endl;
+  }
 }
 
 inline int Simulate(int argc, const char** argv) {
   neuroscience::InitModule();
+  Param::RegisterParamGroup(new SimParam());
   Simulation simulation(argc, argv);
-  AddInitialNeuron({150, 75, 0});
-  AddInitialNeuron({150, 100, 0});
-  AddInitialNeuron({150, 125, 0});
+  auto* sparam = simulation.GetParam()->Get<SimParam>();
+  AddNeuronPopulation(
+      PlaceSomata(sparam, simulation.GetParam()->random_seed));
 
-  // Schedule synapse operation
-  auto* synapsification_op = NewOperation("synapse_op");
-  simulation.GetScheduler()->ScheduleOp(synapsification_op);
+  auto* scheduler = simulation.GetScheduler();
+  if (sparam->detection_steps > sparam->simulation_steps) {
+    Log::Fatal("Simulate", "detection_steps exceeds simulation_steps");
+  }
+  PhasePipeline pipeline(scheduler);
+  pipeline.AddScheduledOps("mechanical forces");
+  // BioDynaMo versions with the continuum interface call it "continuum"
+  pipeline.AddScheduledOps("diffusion", {"continuum"});
+  pipeline.AddScheduledOps("behavior");
+
+  // Synapse detection
+  auto* synapse = NewOperation("synapse_op");
+  pipeline.AddOp(synapse);
+  // operations of the growth phase; only the ones that are added are listed,
+  // since the pipeline warns about unknown names
+  std::vector<std::string> growth_ops = {"mechanical forces", "diffusion",
+                                         "behavior"};
+  auto add_growth_op = [&](Operation* op, OpType type = kSchedule) {
+    pipeline.AddOp(op, type);
+    growth_ops.push_back(op->name_);
+  };
+  // Batched dendrite growth
+  Operation* growth_op = nullptr;
+  if (sparam->batched_growth) {
+    growth_op = NewOperation("dendrite_growth");
+    add_growth_op(growth_op);
+  }
+  // Merge straight chains of retired neurite elements
+  if (sparam->coarsening_interval != 0) {
+    auto* coarsening_op = NewOperation("neurite_coarsening");
+    coarsening_op->frequency_ = sparam->coarsening_interval;
+    add_growth_op(coarsening_op);
+  }
+  // Exclude finished subtrees from mechanics
+  if (sparam->freeze_interval != 0) {
+    auto* freezing_op = NewOperation("neurite_freezing");
+    freezing_op->frequency_ = sparam->freeze_interval;
+    add_growth_op(freezing_op);
+  }
+  // Deposit the secretions of each step
+  if (sparam->secretion_rate > 0) {
+    add_growth_op(NewOperation("secretion"));
+  }
+  Operation* constant_op = nullptr;
+  if (sparam->skip_constant_diffusion) {
+    constant_op = NewOperation("constant_substances");
+    constant_op->GetImplementation<constant_substance_op>()->SetPipeline(
+        &pipeline);
+    add_growth_op(constant_op, kPreSchedule);
+  }
+  // Refine the fine substance blocks around the tips of growth behaviors and
+  // free the blocks the growing tips left behind
+  if (sparam->substance_representation == "multires") {
+    add_growth_op(NewOperation("multires_update"));
+  }
+  if (sparam->benchmark_gradients) {
+    scheduler->ScheduleOp(NewOperation("gradient_benchmark"));
+  }
+  if (sparam->benchmark_growth) {
+    scheduler->ScheduleOp(NewOperation("growth_benchmark"));
+  }
+  // Save snapshots of the growing morphology
+  if (sparam->morphology_interval != 0) {
+    auto* morphology_op = NewOperation("morphology_export");
+    morphology_op->frequency_ = sparam->morphology_interval;
+    add_growth_op(morphology_op);
+  }
+  // Park the behaviors that stopped during the step
+  scheduler->ScheduleOp(NewOperation("behavior_parking"), kPostSchedule);
+  if (sparam->report_allocations) {
+    scheduler->ScheduleOp(NewOperation("allocation_report"), kPostSchedule);
+  }
 
   CreateExtracellularSubstances(simulation.GetParam());
-  simulation.GetScheduler()->Simulate(500);
-  SaveNeuronMorphology(simulation);
-  export_connection_list();
+
+  // Neurites grow under mechanics and diffusion until growth converged.
+  pipeline.AddPhase({"growth",
+                     sparam->simulation_steps - sparam->detection_steps,
+                     growth_ops, nullptr, GrowthConvergence(growth_op)});
+  // The morphology is final: pending growth is written back, and mechanics,
+  // diffusion and growth are switched off.
+  pipeline.AddPhase({"freeze", 0, {},
+                     [&]() { FinishGrowth(growth_op, constant_op); },
+                     nullptr});
+  pipeline.AddPhase({"detection", sparam->detection_steps, {"synapse_op"},
+                     [&]() {
+                       synapse->GetImplementation<synapse_op>()->SetEndStep(
+                           scheduler->GetSimulatedSteps() +
+                           sparam->detection_steps);
+                     },
+                     nullptr});
+  pipeline.AddPhase({"export", 0, {},
+                     [&]() {
+                       SaveNeuronMorphology(simulation);
+                       export_connection_list();
+                     },
+                     nullptr});
+  pipeline.Run();
+  AsyncWriter::Get()->Wait();
   std::cout << "Simulation completed successfully!" << std::endl;
   return 0;
 }